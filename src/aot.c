@@ -0,0 +1,465 @@
+#include "aot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "isa.h"
+#include "shell.h"
+
+typedef enum {
+    K_PLAIN,    /* falls through to pc + 4 */
+    K_BRANCH,   /* conditional, static target */
+    K_JUMP,     /* unconditional, static target */
+    K_INDIRECT, /* JR, JALR */
+    K_UNKNOWN,  /* left to the interpreter */
+} aot_kind_t;
+
+static uint32_t branch_target(uint32_t pc, uint32_t inst) {
+    if (ISA_INFO[isa_decode(inst)].kind == ISA_KIND_JUMP) {
+        return (pc & 0xf0000000) | (extract_target(inst) << 2);
+    }
+    return pc + 4 + (sign_ext(extract_imm(inst)) << 2);
+}
+
+/// Write the C body of a plain instruction into `buf`. Returns 0 for ids
+/// the translator has no rule for, which are left to the interpreter.
+static int emit_plain(char *buf, size_t len, uint32_t inst) {
+    uint32_t rs = extract_rs(inst);
+    uint32_t rt = extract_rt(inst);
+    uint32_t rd = extract_rd(inst);
+    uint32_t imm = extract_imm(inst);
+    uint32_t shamt = extract_shamt(inst);
+    uint32_t simm = sign_ext(imm);
+
+    switch (isa_decode(inst)) {
+        case ISA_SLL:
+            snprintf(buf, len, "r%u = r%u << %u;", rd, rt, shamt);
+            return 1;
+        case ISA_SRL:
+            snprintf(buf, len, "r%u = r%u >> %u;", rd, rt, shamt);
+            return 1;
+        case ISA_SRA:
+            snprintf(buf, len, "r%u = (uint32_t)((int32_t)r%u >> %u);", rd,
+                     rt, shamt);
+            return 1;
+        case ISA_SLLV:
+            snprintf(buf, len, "r%u = r%u << (r%u & 0x1f);", rd, rt, rs);
+            return 1;
+        case ISA_SRLV:
+            snprintf(buf, len, "r%u = r%u >> (r%u & 0x1f);", rd, rt, rs);
+            return 1;
+        case ISA_SRAV:
+            snprintf(buf, len,
+                     "r%u = (uint32_t)((int32_t)r%u >> (r%u & 0x1f));", rd, rt,
+                     rs);
+            return 1;
+        case ISA_MFHI:
+            snprintf(buf, len, "r%u = hi;", rd);
+            return 1;
+        case ISA_MTHI:
+            snprintf(buf, len, "hi = r%u;", rs);
+            return 1;
+        case ISA_MFLO:
+            snprintf(buf, len, "r%u = lo;", rd);
+            return 1;
+        case ISA_MTLO:
+            snprintf(buf, len, "lo = r%u;", rs);
+            return 1;
+        case ISA_MULT:
+            /* the interpreter keeps only the low word of the product */
+            snprintf(buf, len,
+                     "lo = (uint32_t)((int64_t)(int32_t)r%u * "
+                     "(int64_t)(int32_t)r%u); hi = 0;",
+                     rs, rt);
+            return 1;
+        case ISA_MULTU:
+            snprintf(buf, len,
+                     "{ uint64_t p = (uint64_t)r%u * r%u; "
+                     "hi = (uint32_t)(p >> 32); lo = (uint32_t)p; }",
+                     rs, rt);
+            return 1;
+        case ISA_DIV:
+            snprintf(buf, len,
+                     "{ int32_t a = (int32_t)r%u, b = (int32_t)r%u; "
+                     "lo = a / b; hi = a %% b; }",
+                     rs, rt);
+            return 1;
+        case ISA_DIVU:
+            snprintf(buf, len,
+                     "{ uint32_t a = r%u, b = r%u; lo = a / b; "
+                     "hi = a %% b; }",
+                     rs, rt);
+            return 1;
+        case ISA_ADD: case ISA_ADDU:
+            snprintf(buf, len, "r%u = r%u + r%u;", rd, rs, rt);
+            return 1;
+        case ISA_SUB: case ISA_SUBU:
+            snprintf(buf, len, "r%u = r%u - r%u;", rd, rs, rt);
+            return 1;
+        case ISA_AND:
+            snprintf(buf, len, "r%u = r%u & r%u;", rd, rs, rt);
+            return 1;
+        case ISA_OR:
+            snprintf(buf, len, "r%u = r%u | r%u;", rd, rs, rt);
+            return 1;
+        case ISA_XOR:
+            snprintf(buf, len, "r%u = r%u ^ r%u;", rd, rs, rt);
+            return 1;
+        case ISA_NOR:
+            snprintf(buf, len, "r%u = ~(r%u | r%u);", rd, rs, rt);
+            return 1;
+        case ISA_SLT:
+            snprintf(buf, len, "r%u = (int32_t)r%u < (int32_t)r%u;", rd, rs,
+                     rt);
+            return 1;
+        case ISA_SLTU:
+            snprintf(buf, len, "r%u = r%u < r%u;", rd, rs, rt);
+            return 1;
+        case ISA_ADDI: case ISA_ADDIU:
+            snprintf(buf, len, "r%u = r%u + 0x%08xu;", rt, rs, simm);
+            return 1;
+        case ISA_SLTI:
+            snprintf(buf, len, "r%u = (int32_t)r%u < (int32_t)0x%08xu;", rt,
+                     rs, simm);
+            return 1;
+        case ISA_SLTIU:
+            snprintf(buf, len, "r%u = r%u < 0x%08xu;", rt, rs, simm);
+            return 1;
+        case ISA_ANDI:
+            snprintf(buf, len, "r%u = r%u & 0x%04xu;", rt, rs, imm);
+            return 1;
+        case ISA_ORI:
+            snprintf(buf, len, "r%u = r%u | 0x%04xu;", rt, rs, imm);
+            return 1;
+        case ISA_XORI:
+            snprintf(buf, len, "r%u = r%u ^ 0x%04xu;", rt, rs, imm);
+            return 1;
+        case ISA_LUI:
+            snprintf(buf, len, "r%u = 0x%08xu;", rt, imm << 16);
+            return 1;
+        case ISA_LB:
+            snprintf(buf, len,
+                     "r%u = (uint32_t)(int8_t)mem_read_32(r%u + 0x%08xu);",
+                     rt, rs, simm);
+            return 1;
+        case ISA_LBU:
+            snprintf(buf, len, "r%u = (uint8_t)mem_read_32(r%u + 0x%08xu);",
+                     rt, rs, simm);
+            return 1;
+        case ISA_LH:
+            snprintf(buf, len,
+                     "r%u = (uint32_t)(int16_t)mem_read_32(r%u + 0x%08xu);",
+                     rt, rs, simm);
+            return 1;
+        case ISA_LHU:
+            snprintf(buf, len, "r%u = (uint16_t)mem_read_32(r%u + 0x%08xu);",
+                     rt, rs, simm);
+            return 1;
+        case ISA_LW:
+            snprintf(buf, len, "r%u = mem_read_32(r%u + 0x%08xu);", rt, rs,
+                     simm);
+            return 1;
+        case ISA_SB:
+            snprintf(buf, len,
+                     "{ uint32_t a = r%u + 0x%08xu; mem_write_32(a, "
+                     "(mem_read_32(a) & 0xffffff00u) | (r%u & 0xffu)); }",
+                     rs, simm, rt);
+            return 1;
+        case ISA_SH:
+            snprintf(buf, len,
+                     "{ uint32_t a = r%u + 0x%08xu; mem_write_32(a, "
+                     "(mem_read_32(a) & 0xffff0000u) | (r%u & 0xffffu)); }",
+                     rs, simm, rt);
+            return 1;
+        case ISA_SW:
+            snprintf(buf, len, "mem_write_32(r%u + 0x%08xu, r%u);", rs, simm,
+                     rt);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/// A division the host would trap on leaves the block before it, with the
+/// `left` instructions from there on not counted, so that the interpreter
+/// runs it and stops the program.
+static void emit_div_guard(FILE *out, uint32_t inst, uint32_t pc,
+                           uint32_t left) {
+    uint32_t rs = extract_rs(inst);
+    uint32_t rt = extract_rt(inst);
+
+    switch (isa_decode(inst)) {
+        case ISA_DIV:
+            fprintf(out,
+                    "    if (r%u == 0 || (r%u == 0x80000000u && "
+                    "r%u == 0xffffffffu)) {\n",
+                    rt, rs, rt);
+            break;
+        case ISA_DIVU:
+            fprintf(out, "    if (r%u == 0) {\n", rt);
+            break;
+        default:
+            return;
+    }
+    fprintf(out, "        executed -= %u; pc = 0x%08xu; goto out;\n    }\n",
+            left, pc);
+}
+
+/// Control transfers emit_control() has a rule for.
+static int control_known(isa_id_t id) {
+    switch (id) {
+        case ISA_JR: case ISA_JALR:
+        case ISA_J: case ISA_JAL:
+        case ISA_BLTZ: case ISA_BGEZ: case ISA_BLTZAL: case ISA_BGEZAL:
+        case ISA_BEQ: case ISA_BNE: case ISA_BLEZ: case ISA_BGTZ:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/// Classify an instruction from its isa.def kind. Anything the interpreter
+/// does not advance the PC for, and anything the translator has no rule
+/// for, is K_UNKNOWN and runs in the interpreter.
+static aot_kind_t classify(uint32_t inst) {
+    isa_id_t id = isa_decode(inst);
+    char body[160];
+
+    if (id == ISA_INVALID) {
+        return K_UNKNOWN;
+    }
+    switch (ISA_INFO[id].kind) {
+        case ISA_KIND_PLAIN:
+            return emit_plain(body, sizeof(body), inst) ? K_PLAIN : K_UNKNOWN;
+        case ISA_KIND_BRANCH:
+            return control_known(id) ? K_BRANCH : K_UNKNOWN;
+        case ISA_KIND_JUMP:
+            return control_known(id) ? K_JUMP : K_UNKNOWN;
+        case ISA_KIND_INDIRECT:
+            return control_known(id) ? K_INDIRECT : K_UNKNOWN;
+        case ISA_KIND_SYSCALL:
+            /* the interpreter owns the registers and host I/O state */
+            return K_UNKNOWN;
+    }
+    return K_UNKNOWN;
+}
+
+/// Emit a transfer to a static address: chain directly into its block while
+/// the budget lasts, otherwise leave through the dispatcher.
+static void emit_goto(FILE *out, const uint8_t *leader, uint32_t start,
+                      uint32_t end, uint32_t target) {
+    if (target >= start && target < end && (target & 3) == 0 &&
+        leader[(target - start) >> 2]) {
+        fprintf(out, "AOT_CHAIN(0x%08xu, B_%08x);", target, target);
+    } else {
+        fprintf(out, "pc = 0x%08xu; goto dispatch;", target);
+    }
+}
+
+/// Emit the terminating control transfer of a block.
+static void emit_control(FILE *out, const uint8_t *leader, uint32_t start,
+                         uint32_t end, uint32_t pc, uint32_t inst) {
+    isa_id_t id = isa_decode(inst);
+    uint32_t rs = extract_rs(inst);
+    uint32_t rt = extract_rt(inst);
+    uint32_t rd = extract_rd(inst);
+    uint32_t next = pc + 4;
+    const char *cond = NULL;
+    char buf[64];
+
+    switch (id) {
+        case ISA_JR:
+            fprintf(out, "    pc = r%u; goto dispatch;\n", rs);
+            return;
+        case ISA_JALR:
+            fprintf(out,
+                    "    { uint32_t t = r%u; r%u = 0x%08xu; pc = t; }"
+                    " goto dispatch;\n",
+                    rs, rd, next);
+            return;
+        case ISA_JAL:
+            fprintf(out, "    r31 = 0x%08xu;\n", next);
+            /* fall through */
+        case ISA_J:
+            fprintf(out, "    ");
+            emit_goto(out, leader, start, end, branch_target(pc, inst));
+            fprintf(out, "\n");
+            return;
+        case ISA_BLTZ: case ISA_BGEZ: case ISA_BLTZAL: case ISA_BGEZAL:
+            fprintf(out, "    { uint32_t c = r%u;", rs);
+            if (id == ISA_BLTZAL || id == ISA_BGEZAL) {
+                fprintf(out, " r31 = 0x%08xu;", next);
+            }
+            fprintf(out, "\n");
+            cond = (id == ISA_BGEZ || id == ISA_BGEZAL) ? "(int32_t)c >= 0"
+                                                        : "(int32_t)c < 0";
+            break;
+        case ISA_BEQ:
+            /* `beq $x, $x` is the assembler's unconditional branch */
+            if (rs == rt) {
+                snprintf(buf, sizeof(buf), "1");
+            } else {
+                snprintf(buf, sizeof(buf), "r%u == r%u", rs, rt);
+            }
+            cond = buf;
+            fprintf(out, "    {\n");
+            break;
+        case ISA_BNE:
+            if (rs == rt) {
+                snprintf(buf, sizeof(buf), "0");
+            } else {
+                snprintf(buf, sizeof(buf), "r%u != r%u", rs, rt);
+            }
+            cond = buf;
+            fprintf(out, "    {\n");
+            break;
+        case ISA_BLEZ:
+            snprintf(buf, sizeof(buf), "(int32_t)r%u <= 0", rs);
+            cond = buf;
+            fprintf(out, "    {\n");
+            break;
+        case ISA_BGTZ:
+            snprintf(buf, sizeof(buf), "(int32_t)r%u > 0", rs);
+            cond = buf;
+            fprintf(out, "    {\n");
+            break;
+        default:
+            /* classify() only lets control_known() ids through */
+            return;
+    }
+    fprintf(out, "    if (%s) { ", cond);
+    emit_goto(out, leader, start, end, branch_target(pc, inst));
+    fprintf(out, " }\n    ");
+    emit_goto(out, leader, start, end, next);
+    fprintf(out, " }\n");
+}
+
+int aot_translate(FILE *out, uint32_t start, uint32_t end) {
+    uint32_t nwords = (end - start) / 4;
+    uint32_t *words = malloc((nwords + 1) * sizeof(uint32_t));
+    uint8_t *kinds = malloc(nwords + 1);
+    uint8_t *leader = calloc(nwords + 1, 1);
+    uint32_t i, r;
+    int nblocks = 0;
+
+    for (i = 0; i < nwords; i++) {
+        words[i] = mem_read_32(start + i * 4);
+        kinds[i] = classify(words[i]);
+    }
+
+    /* block leaders: entry, static targets, and whatever follows a transfer */
+    if (nwords > 0) {
+        leader[0] = 1;
+    }
+    for (i = 0; i < nwords; i++) {
+        uint32_t pc = start + i * 4;
+        if (kinds[i] == K_BRANCH || kinds[i] == K_JUMP) {
+            uint32_t target = branch_target(pc, words[i]);
+            if (target >= start && target < end && (target & 3) == 0) {
+                leader[(target - start) >> 2] = 1;
+            }
+        }
+        if (kinds[i] != K_PLAIN && i + 1 < nwords) {
+            leader[i + 1] = 1;
+        }
+    }
+    for (i = 0; i < nwords; i++) {
+        if (kinds[i] == K_UNKNOWN) {
+            leader[i] = 0;
+        }
+    }
+
+    fprintf(out, "/* Generated by `sim --aot`, do not edit. */\n\n");
+    fprintf(out, "#include <stdint.h>\n\n#include \"shell.h\"\n"
+                 "#include \"aot.h\"\n\n");
+
+    fprintf(out, "const uint32_t AOT_TEXT_START = 0x%08xu;\n", start);
+    fprintf(out, "const uint32_t AOT_TEXT_WORDS = %uu;\n", nwords);
+    fprintf(out, "const uint32_t AOT_TEXT[] = {");
+    for (i = 0; i < nwords; i++) {
+        fprintf(out, "%s0x%08xu,", i % 6 == 0 ? "\n    " : " ", words[i]);
+    }
+    fprintf(out, "\n    0\n};\n\n");
+
+    fprintf(out,
+            "#define AOT_CHAIN(target, label) \\\n"
+            "    do { pc = (target); if (executed < budget) goto label; "
+            "goto out; } while (0)\n\n");
+
+    fprintf(out, "uint32_t aot_run(uint32_t budget) {\n");
+    for (r = 0; r < MIPS_REGS; r++) {
+        fprintf(out, "    uint32_t r%u = CURRENT_STATE.REGS[%u];\n", r, r);
+    }
+    fprintf(out, "    uint32_t hi = CURRENT_STATE.HI, lo = CURRENT_STATE.LO;\n");
+    fprintf(out, "    uint32_t pc = CURRENT_STATE.PC;\n");
+    fprintf(out, "    uint32_t executed = 0;\n\n");
+
+    fprintf(out, "dispatch:\n    if (executed >= budget) goto out;\n");
+    fprintf(out, "    switch (pc) {\n");
+    for (i = 0; i < nwords; i++) {
+        if (leader[i]) {
+            uint32_t pc = start + i * 4;
+            fprintf(out, "        case 0x%08xu: goto B_%08x;\n", pc, pc);
+        }
+    }
+    fprintf(out, "        default: goto out;\n    }\n\n");
+
+    for (i = 0; i < nwords;) {
+        uint32_t first = i, count, pc;
+
+        if (!leader[i]) {
+            i++;
+            continue;
+        }
+        nblocks++;
+
+        /* block extent: up to the next leader or a terminator */
+        while (i < nwords && kinds[i] == K_PLAIN &&
+               (i == first || !leader[i])) {
+            i++;
+        }
+        if (i < nwords && kinds[i] != K_PLAIN && kinds[i] != K_UNKNOWN &&
+            (i == first || !leader[i])) {
+            i++;
+        }
+        count = i - first;
+
+        fprintf(out, "B_%08x:\n    executed += %u;\n", start + first * 4,
+                count);
+        for (pc = first; pc < i; pc++) {
+            uint32_t addr = start + pc * 4;
+            if (kinds[pc] == K_PLAIN) {
+                char body[160];
+                emit_div_guard(out, words[pc], addr, count - (pc - first));
+                emit_plain(body, sizeof(body), words[pc]);
+                fprintf(out, "    /* %08x: %08x */ %s\n", addr, words[pc],
+                        body);
+            } else {
+                fprintf(out, "    /* %08x: %08x */\n", addr, words[pc]);
+                emit_control(out, leader, start, end, addr, words[pc]);
+            }
+        }
+        if (kinds[i - 1] == K_PLAIN) {
+            fprintf(out, "    ");
+            emit_goto(out, leader, start, end, start + i * 4);
+            fprintf(out, "\n");
+        }
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "out:\n");
+    for (r = 0; r < MIPS_REGS; r++) {
+        fprintf(out, "    CURRENT_STATE.REGS[%u] = r%u;\n", r, r);
+    }
+    fprintf(out, "    CURRENT_STATE.HI = hi;\n    CURRENT_STATE.LO = lo;\n");
+    fprintf(out, "    CURRENT_STATE.PC = pc;\n");
+    fprintf(out, "    NEXT_STATE = CURRENT_STATE;\n");
+    fprintf(out, "    INSTRUCTION_COUNT += executed;\n");
+    fprintf(out, "    return executed;\n}\n");
+
+    free(words);
+    free(kinds);
+    free(leader);
+    return nblocks;
+}
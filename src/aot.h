@@ -0,0 +1,27 @@
+#ifndef _SIM_AOT_H_
+#define _SIM_AOT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/// Translate the words in [start, end) of guest memory into a C file which
+/// defines `aot_run` and friends. Returns the number of basic blocks.
+int aot_translate(FILE *out, uint32_t start, uint32_t end);
+
+/*
+ * The symbols below are provided by a generated translation, and only exist
+ * in builds with SIM_AOT defined (`make sim-aot AOT=prog_aot.c`).
+ */
+
+extern const uint32_t AOT_TEXT_START;
+extern const uint32_t AOT_TEXT_WORDS;
+extern const uint32_t AOT_TEXT[];
+
+/// Run translated code from CURRENT_STATE.PC until the guest halts, jumps to
+/// an address with no translated block, or at least `budget` instructions
+/// have been executed. Updates CURRENT_STATE, NEXT_STATE and
+/// INSTRUCTION_COUNT, and returns the number of instructions executed; 0
+/// means the current PC must be stepped by the interpreter.
+uint32_t aot_run(uint32_t budget);
+
+#endif
@@ -0,0 +1,1467 @@
+#include "asm.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "isa.h"
+
+/// Register used by pseudo-instruction expansions.
+#define REG_AT 1
+
+#define MAX_OPERANDS 4
+#define MAX_LINE_LABELS 8
+
+typedef enum {
+    SEG_TEXT,
+    SEG_DATA,
+} asm_segment_t;
+
+typedef enum {
+    FIX_BRANCH, /* 16 bit word offset from pc + 4 */
+    FIX_JUMP,   /* 26 bit word index */
+    FIX_HI,     /* upper half, paired with ori */
+    FIX_HI_ADJ, /* upper half, paired with a sign extended offset */
+    FIX_LO,     /* lower half */
+    FIX_WORD,   /* full 32 bit word */
+    FIX_HALF,
+    FIX_BYTE,
+} asm_fixup_kind_t;
+
+typedef struct {
+    asm_fixup_kind_t kind;
+    asm_segment_t seg;
+    uint32_t offset; /* word index in text, byte offset in data */
+    const char *symbol;
+    int64_t addend;
+    uint32_t line;
+} asm_fixup_t;
+
+typedef struct {
+    int64_t value;
+    const char *symbol; /* NULL for plain constants */
+} asm_expr_t;
+
+typedef struct {
+    asm_program_t *prog;
+    asm_segment_t seg;
+    uint32_t line;
+
+    asm_fixup_t *fixups;
+    uint32_t num_fixups, fixups_cap;
+
+    const char *labels[MAX_LINE_LABELS];
+    int num_labels;
+} asm_state_t;
+
+/***************************************************************/
+/* Instruction formats.                                        */
+/***************************************************************/
+
+typedef enum {
+    F_R3,      /* rd, rs, rt */
+    F_SHIFT,   /* rd, rt, shamt */
+    F_SHIFTV,  /* rd, rt, rs */
+    F_JR,      /* rs */
+    F_JALR,    /* [rd,] rs */
+    F_MULDIV,  /* rs, rt */
+    F_MF,      /* rd */
+    F_MT,      /* rs */
+    F_SYSCALL, /* no operands */
+    F_IARITH,  /* rt, rs, signed imm */
+    F_ILOGIC,  /* rt, rs, unsigned imm */
+    F_LUI,     /* rt, imm */
+    F_BR2,     /* rs, rt, label */
+    F_BR1,     /* rs, label */
+    F_REGIMM,  /* rs, label, rt field selects the condition */
+    F_MEM,     /* rt, offset(base) */
+    F_J,       /* label */
+} asm_format_t;
+
+typedef struct {
+    char name[8];
+    asm_format_t fmt;
+    uint32_t op;
+    uint32_t code; /* funct, or rt for REGIMM */
+    const char *alt; /* I-form of an R3 op or R-form of an immediate op */
+} asm_op_t;
+
+/// Mnemonics which swap with another form: an R3 op given an immediate
+/// assembles as its I-form, an immediate op given a register as its R-form.
+static const char *const ASM_ALTS[][2] = {
+    { "add", "addi" },   { "addu", "addiu" }, { "and", "andi" },
+    { "or", "ori" },     { "xor", "xori" },   { "slt", "slti" },
+    { "sltu", "sltiu" },
+};
+
+#define ASM_NALTS (sizeof(ASM_ALTS) / sizeof(ASM_ALTS[0]))
+
+/// The machine instructions, one per isa.def entry, so that the assembler
+/// emits only what the interpreters run. Filled in by init_ops().
+static asm_op_t ASM_OPS[ISA_INVALID];
+
+
+const char *const ASM_REG_NAMES[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0",   "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0",   "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8",   "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+};
+
+static uint32_t encode_r(uint32_t rs, uint32_t rt, uint32_t rd,
+                         uint32_t shamt, uint32_t funct) {
+    return (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | funct;
+}
+
+static uint32_t encode_i(uint32_t op, uint32_t rs, uint32_t rt,
+                         uint32_t imm) {
+    return (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xffff);
+}
+
+static asm_format_t op_format(const isa_info_t *info) {
+    switch ((isa_format_t)info->format) {
+        case ISA_FMT_NONE:
+            return F_SYSCALL;
+        case ISA_FMT_R3:
+            return F_R3;
+        case ISA_FMT_SHIFT:
+            return F_SHIFT;
+        case ISA_FMT_SHIFTV:
+            return F_SHIFTV;
+        case ISA_FMT_JR:
+            return F_JR;
+        case ISA_FMT_JALR:
+            return F_JALR;
+        case ISA_FMT_MF:
+            return F_MF;
+        case ISA_FMT_MT:
+            return F_MT;
+        case ISA_FMT_MD:
+            return F_MULDIV;
+        case ISA_FMT_IS:
+            return F_IARITH;
+        case ISA_FMT_IU:
+            return F_ILOGIC;
+        case ISA_FMT_LUI:
+            return F_LUI;
+        case ISA_FMT_B2:
+            return F_BR2;
+        case ISA_FMT_B1:
+            /* BLEZ and BGTZ have opcodes of their own */
+            return extract_op(info->match) == 1 ? F_REGIMM : F_BR1;
+        case ISA_FMT_J:
+            return F_J;
+        case ISA_FMT_MEM:
+            return F_MEM;
+    }
+    return F_SYSCALL;
+}
+
+static void init_ops(void) {
+    int id, i, j;
+
+    for (id = 0; id < ISA_INVALID; id++) {
+        const isa_info_t *info = &ISA_INFO[id];
+        asm_op_t *op = &ASM_OPS[id];
+
+        for (i = 0; info->name[i] != '\0' && i + 1 < sizeof(op->name); i++) {
+            op->name[i] = tolower((unsigned char)info->name[i]);
+        }
+        op->name[i] = '\0';
+        op->fmt = op_format(info);
+        op->op = extract_op(info->match);
+        op->code = op->op == 0   ? extract_funct(info->match)
+                   : op->op == 1 ? extract_rt(info->match)
+                                 : 0;
+        op->alt = NULL;
+        for (j = 0; j < ASM_NALTS; j++) {
+            if (strcmp(ASM_ALTS[j][0], op->name) == 0) {
+                op->alt = ASM_ALTS[j][1];
+            } else if (strcmp(ASM_ALTS[j][1], op->name) == 0) {
+                op->alt = ASM_ALTS[j][0];
+            }
+        }
+    }
+}
+
+static const asm_op_t *find_op(const char *name) {
+    int i;
+
+    if (ASM_OPS[0].name[0] == '\0') {
+        init_ops();
+    }
+    for (i = 0; i < ISA_INVALID; i++) {
+        if (strcmp(ASM_OPS[i].name, name) == 0) {
+            return &ASM_OPS[i];
+        }
+    }
+    return NULL;
+}
+
+/***************************************************************/
+/* Errors and storage.                                         */
+/***************************************************************/
+
+static int error(asm_state_t *st, const char *fmt, ...) {
+    int n = snprintf(st->prog->error, sizeof(st->prog->error), "line %u: ",
+                     st->line);
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(st->prog->error + n, sizeof(st->prog->error) - n, fmt, args);
+    va_end(args);
+    return -1;
+}
+
+/// Copy a string into the name arena. Blocks are chained through their first
+/// bytes and never move, so returned pointers stay valid until `asm_free`.
+static const char *intern(asm_program_t *prog, const char *s) {
+    size_t len = strlen(s) + 1;
+    if (prog->names == NULL || prog->names_len + len > prog->names_cap) {
+        size_t cap = len + sizeof(char *) > 4096 ? len + sizeof(char *) : 4096;
+        char *block = malloc(cap);
+        memcpy(block, &prog->names, sizeof(char *));
+        prog->names = block;
+        prog->names_len = sizeof(char *);
+        prog->names_cap = cap;
+    }
+    char *dst = prog->names + prog->names_len;
+    memcpy(dst, s, len);
+    prog->names_len += len;
+    return dst;
+}
+
+static uint32_t hash_name(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    }
+    return h;
+}
+
+const asm_symbol_t *asm_find_symbol(const asm_program_t *prog,
+                                    const char *name) {
+    if (prog->symbol_index_cap == 0) {
+        return NULL;
+    }
+    uint32_t mask = prog->symbol_index_cap - 1;
+    uint32_t i = hash_name(name) & mask;
+    while (prog->symbol_index[i] != 0) {
+        const asm_symbol_t *sym = &prog->symbols[prog->symbol_index[i] - 1];
+        if (strcmp(sym->name, name) == 0) {
+            return sym;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void index_symbol(asm_program_t *prog, uint32_t idx) {
+    uint32_t mask = prog->symbol_index_cap - 1;
+    uint32_t i = hash_name(prog->symbols[idx].name) & mask;
+    while (prog->symbol_index[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    prog->symbol_index[i] = idx + 1;
+}
+
+static int define_symbol(asm_state_t *st, const char *name, uint32_t addr) {
+    asm_program_t *prog = st->prog;
+
+    if (asm_find_symbol(prog, name) != NULL) {
+        return error(st, "label '%s' is already defined", name);
+    }
+
+    if (prog->num_symbols == prog->symbols_cap) {
+        prog->symbols_cap = prog->symbols_cap ? prog->symbols_cap * 2 : 64;
+        prog->symbols =
+            realloc(prog->symbols, prog->symbols_cap * sizeof(asm_symbol_t));
+    }
+    prog->symbols[prog->num_symbols].name = intern(prog, name);
+    prog->symbols[prog->num_symbols].addr = addr;
+    prog->num_symbols++;
+
+    if (prog->num_symbols * 2 > prog->symbol_index_cap) {
+        uint32_t i;
+        prog->symbol_index_cap =
+            prog->symbol_index_cap ? prog->symbol_index_cap * 2 : 128;
+        free(prog->symbol_index);
+        prog->symbol_index =
+            calloc(prog->symbol_index_cap, sizeof(uint32_t));
+        for (i = 0; i < prog->num_symbols; i++) {
+            index_symbol(prog, i);
+        }
+    } else {
+        index_symbol(prog, prog->num_symbols - 1);
+    }
+    return 0;
+}
+
+static uint32_t text_addr(asm_state_t *st) {
+    return st->prog->text_base + st->prog->text_len * 4;
+}
+
+static uint32_t data_addr(asm_state_t *st) {
+    return st->prog->data_base + st->prog->data_len;
+}
+
+static void emit(asm_state_t *st, uint32_t word) {
+    asm_program_t *prog = st->prog;
+    if (prog->text_len == prog->text_cap) {
+        prog->text_cap = prog->text_cap ? prog->text_cap * 2 : 256;
+        prog->text = realloc(prog->text, prog->text_cap * sizeof(uint32_t));
+        prog->text_lines =
+            realloc(prog->text_lines, prog->text_cap * sizeof(uint32_t));
+    }
+    prog->text[prog->text_len] = word;
+    prog->text_lines[prog->text_len] = st->line;
+    prog->text_len++;
+}
+
+static void emit_data(asm_state_t *st, const void *bytes, uint32_t len) {
+    asm_program_t *prog = st->prog;
+    if (prog->data_len + len > prog->data_cap) {
+        uint32_t cap = prog->data_cap ? prog->data_cap : 1024;
+        while (cap < prog->data_len + len) {
+            cap *= 2;
+        }
+        prog->data = realloc(prog->data, cap);
+        prog->data_cap = cap;
+    }
+    if (bytes != NULL) {
+        memcpy(prog->data + prog->data_len, bytes, len);
+    } else {
+        memset(prog->data + prog->data_len, 0, len);
+    }
+    prog->data_len += len;
+}
+
+static void align_data(asm_state_t *st, uint32_t align) {
+    uint32_t pad = (align - (st->prog->data_len % align)) % align;
+    if (pad != 0) {
+        emit_data(st, NULL, pad);
+    }
+}
+
+static void add_fixup(asm_state_t *st, asm_fixup_kind_t kind,
+                      const asm_expr_t *expr) {
+    if (st->num_fixups == st->fixups_cap) {
+        st->fixups_cap = st->fixups_cap ? st->fixups_cap * 2 : 64;
+        st->fixups =
+            realloc(st->fixups, st->fixups_cap * sizeof(asm_fixup_t));
+    }
+    asm_fixup_t *fix = &st->fixups[st->num_fixups++];
+    fix->kind = kind;
+    fix->seg = st->seg;
+    fix->offset = st->seg == SEG_TEXT ? st->prog->text_len : st->prog->data_len;
+    fix->symbol = intern(st->prog, expr->symbol);
+    fix->addend = expr->value;
+    fix->line = st->line;
+}
+
+/// Define the labels seen on the current line at the current location.
+static int flush_labels(asm_state_t *st) {
+    int i;
+    uint32_t addr = st->seg == SEG_TEXT ? text_addr(st) : data_addr(st);
+    for (i = 0; i < st->num_labels; i++) {
+        if (define_symbol(st, st->labels[i], addr) != 0) {
+            return -1;
+        }
+    }
+    st->num_labels = 0;
+    return 0;
+}
+
+/***************************************************************/
+/* Operand parsing.                                            */
+/***************************************************************/
+
+static char *trim(char *s) {
+    char *end;
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+static int is_ident_start(char c) {
+    return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static int is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static int parse_reg(asm_state_t *st, const char *tok, uint32_t *reg) {
+    int i;
+    if (tok[0] != '$') {
+        return error(st, "expected register, got '%s'", tok);
+    }
+    tok++;
+    if (isdigit((unsigned char)tok[0])) {
+        char *end;
+        long n = strtol(tok, &end, 10);
+        if (*end == '\0' && n >= 0 && n < 32) {
+            *reg = (uint32_t)n;
+            return 0;
+        }
+    } else {
+        for (i = 0; i < 32; i++) {
+            if (strcmp(tok, ASM_REG_NAMES[i]) == 0) {
+                *reg = (uint32_t)i;
+                return 0;
+            }
+        }
+        if (strcmp(tok, "s8") == 0) {
+            *reg = 30;
+            return 0;
+        }
+    }
+    return error(st, "unknown register '$%s'", tok);
+}
+
+static int parse_char(const char **p, int *c) {
+    const char *s = *p;
+    if (*s == '\\') {
+        s++;
+        switch (*s) {
+            case 'n': *c = '\n'; break;
+            case 't': *c = '\t'; break;
+            case 'r': *c = '\r'; break;
+            case '0': *c = '\0'; break;
+            case '\\': *c = '\\'; break;
+            case '\'': *c = '\''; break;
+            case '"': *c = '"'; break;
+            default: return -1;
+        }
+    } else if (*s == '\0') {
+        return -1;
+    } else {
+        *c = (unsigned char)*s;
+    }
+    *p = s + 1;
+    return 0;
+}
+
+static int parse_number(const char **p, int64_t *value) {
+    const char *s = *p;
+    int neg = 0;
+    uint64_t v = 0;
+
+    if (*s == '-' || *s == '+') {
+        neg = *s == '-';
+        s++;
+    }
+    if (*s == '\'') {
+        int c;
+        s++;
+        if (parse_char(&s, &c) != 0 || *s != '\'') {
+            return -1;
+        }
+        v = (uint64_t)c;
+        s++;
+    } else if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        s += 2;
+        if (!isxdigit((unsigned char)*s)) {
+            return -1;
+        }
+        while (isxdigit((unsigned char)*s)) {
+            int d = isdigit((unsigned char)*s) ? *s - '0'
+                                                : (tolower(*s) - 'a' + 10);
+            v = v * 16 + d;
+            s++;
+        }
+    } else if (isdigit((unsigned char)*s)) {
+        while (isdigit((unsigned char)*s)) {
+            v = v * 10 + (*s - '0');
+            s++;
+        }
+    } else {
+        return -1;
+    }
+    if (v > 0xffffffffull) {
+        return -1;
+    }
+    *value = neg ? -(int64_t)v : (int64_t)v;
+    *p = s;
+    return 0;
+}
+
+/// Parse `constant`, `label`, `label+constant` or `label-constant`.
+static int parse_expr(asm_state_t *st, char *tok, asm_expr_t *expr) {
+    const char *s = tok;
+
+    expr->value = 0;
+    expr->symbol = NULL;
+
+    if (is_ident_start(*s) && *s != '$') {
+        char *start = tok;
+        while (is_ident_char(*s)) {
+            s++;
+        }
+        if (*s == '\0') {
+            expr->symbol = start;
+            return 0;
+        }
+        if (*s != '+' && *s != '-') {
+            return error(st, "malformed expression '%s'", tok);
+        }
+        /* split the symbol off in place, keeping the sign for the addend */
+        char sign = *s;
+        tok[s - tok] = '\0';
+        expr->symbol = start;
+        s++;
+        if (parse_number(&s, &expr->value) != 0 || *s != '\0') {
+            return error(st, "malformed expression after '%s'", start);
+        }
+        if (sign == '-') {
+            expr->value = -expr->value;
+        }
+        return 0;
+    }
+
+    if (parse_number(&s, &expr->value) != 0 || *s != '\0') {
+        return error(st, "malformed number '%s'", tok);
+    }
+    return 0;
+}
+
+static int parse_const(asm_state_t *st, char *tok, int64_t *value) {
+    asm_expr_t expr;
+    if (parse_expr(st, tok, &expr) != 0) {
+        return -1;
+    }
+    if (expr.symbol != NULL) {
+        return error(st, "expected constant, got '%s'", tok);
+    }
+    *value = expr.value;
+    return 0;
+}
+
+/// Split `s` on top-level commas, honouring quoted strings.
+static int split_operands(asm_state_t *st, char *s, char **ops) {
+    int n = 0;
+    int quoted = 0;
+    char *start = s;
+
+    s = trim(s);
+    if (*s == '\0') {
+        return 0;
+    }
+    start = s;
+    for (; *s; s++) {
+        if (*s == '"' && (s == start || s[-1] != '\\')) {
+            quoted = !quoted;
+        } else if (*s == ',' && !quoted) {
+            if (n == MAX_OPERANDS) {
+                return error(st, "too many operands");
+            }
+            *s = '\0';
+            ops[n++] = trim(start);
+            start = s + 1;
+        }
+    }
+    if (n == MAX_OPERANDS) {
+        return error(st, "too many operands");
+    }
+    ops[n++] = trim(start);
+    return n;
+}
+
+static int expect_operands(asm_state_t *st, const char *name, int got,
+                           int want) {
+    if (got != want) {
+        return error(st, "'%s' expects %d operand(s), got %d", name, want,
+                     got);
+    }
+    return 0;
+}
+
+static int fits_signed16(int64_t v) { return v >= -32768 && v <= 32767; }
+
+static int fits_unsigned16(int64_t v) { return v >= 0 && v <= 0xffff; }
+
+/***************************************************************/
+/* Instruction emission.                                       */
+/***************************************************************/
+
+/// lui $at, hi ; ori $at, $at, lo
+static void emit_at_const(asm_state_t *st, uint32_t value) {
+    emit(st, encode_i(0x0f, 0, REG_AT, value >> 16));
+    emit(st, encode_i(0x0d, REG_AT, REG_AT, value & 0xffff));
+}
+
+static void emit_li(asm_state_t *st, uint32_t rt, int64_t value) {
+    if (fits_signed16(value)) {
+        emit(st, encode_i(0x09, 0, rt, (uint32_t)value));
+    } else if (fits_unsigned16(value)) {
+        emit(st, encode_i(0x0d, 0, rt, (uint32_t)value));
+    } else {
+        emit(st, encode_i(0x0f, 0, REG_AT, (uint32_t)value >> 16));
+        emit(st, encode_i(0x0d, REG_AT, rt, (uint32_t)value & 0xffff));
+    }
+}
+
+static void emit_branch(asm_state_t *st, uint32_t op, uint32_t rs,
+                        uint32_t rt, asm_expr_t *target) {
+    if (target->symbol != NULL) {
+        add_fixup(st, FIX_BRANCH, target);
+        emit(st, encode_i(op, rs, rt, 0));
+    } else {
+        /* numeric targets are absolute addresses */
+        int64_t offset = (target->value - (int64_t)(text_addr(st) + 4)) >> 2;
+        emit(st, encode_i(op, rs, rt, (uint32_t)offset));
+    }
+}
+
+/// Immediate ALU op, expanding through $at when the constant does not fit.
+static int emit_imm_op(asm_state_t *st, const asm_op_t *op, uint32_t rt,
+                       uint32_t rs, char *tok) {
+    asm_expr_t expr;
+    if (parse_expr(st, tok, &expr) != 0) {
+        return -1;
+    }
+    if (expr.symbol != NULL) {
+        add_fixup(st, FIX_LO, &expr);
+        emit(st, encode_i(op->op, rs, rt, 0));
+        return 0;
+    }
+
+    int fits = op->fmt == F_ILOGIC ? fits_unsigned16(expr.value)
+                                    : fits_signed16(expr.value);
+    if (fits) {
+        emit(st, encode_i(op->op, rs, rt, (uint32_t)expr.value));
+    } else {
+        const asm_op_t *r_op = find_op(op->alt);
+        emit_at_const(st, (uint32_t)expr.value);
+        emit(st, encode_r(rs, REG_AT, rt, 0, r_op->code));
+    }
+    return 0;
+}
+
+/// Loads and stores: `off(base)`, `(base)`, `label`, `label(base)`, `const`.
+static int emit_mem(asm_state_t *st, uint32_t op, uint32_t rt, char *tok) {
+    uint32_t base = 0;
+    char *paren = strchr(tok, '(');
+    asm_expr_t expr = { 0, NULL };
+
+    if (paren != NULL) {
+        char *close = strchr(paren, ')');
+        if (close == NULL || trim(close + 1)[0] != '\0') {
+            return error(st, "malformed memory operand '%s'", tok);
+        }
+        *close = '\0';
+        *paren = '\0';
+        if (parse_reg(st, trim(paren + 1), &base) != 0) {
+            return -1;
+        }
+        tok = trim(tok);
+        if (*tok != '\0' && parse_expr(st, tok, &expr) != 0) {
+            return -1;
+        }
+    } else if (parse_expr(st, tok, &expr) != 0) {
+        return -1;
+    }
+
+    if (expr.symbol == NULL && fits_signed16(expr.value)) {
+        emit(st, encode_i(op, base, rt, (uint32_t)expr.value));
+        return 0;
+    }
+
+    /* lui $at, %hi ; [addu $at, $at, base] ; op rt, %lo($at) */
+    if (expr.symbol != NULL) {
+        add_fixup(st, FIX_HI_ADJ, &expr);
+        emit(st, encode_i(0x0f, 0, REG_AT, 0));
+    } else {
+        uint32_t v = (uint32_t)expr.value;
+        emit(st, encode_i(0x0f, 0, REG_AT, (v + 0x8000) >> 16));
+    }
+    if (base != 0) {
+        emit(st, encode_r(REG_AT, base, REG_AT, 0, 0x21));
+    }
+    if (expr.symbol != NULL) {
+        add_fixup(st, FIX_LO, &expr);
+        emit(st, encode_i(op, REG_AT, rt, 0));
+    } else {
+        emit(st, encode_i(op, REG_AT, rt, (uint32_t)expr.value & 0xffff));
+    }
+    return 0;
+}
+
+/// Second operand of a compare-and-branch pseudo: a register, or a constant
+/// loaded into $at.
+static int branch_operand(asm_state_t *st, char *tok, uint32_t *reg) {
+    if (tok[0] == '$') {
+        return parse_reg(st, tok, reg);
+    }
+    int64_t value = 0;
+    if (parse_const(st, tok, &value) != 0) {
+        return -1;
+    }
+    emit_li(st, REG_AT, value);
+    *reg = REG_AT;
+    return 0;
+}
+
+static int emit_native(asm_state_t *st, const asm_op_t *op, char **ops,
+                       int n) {
+    uint32_t rs = 0, rt = 0, rd = 0;
+    int64_t value = 0;
+    asm_expr_t expr;
+
+    switch (op->fmt) {
+        case F_R3:
+            if (expect_operands(st, op->name, n, 3) != 0 ||
+                parse_reg(st, ops[0], &rd) != 0 ||
+                parse_reg(st, ops[1], &rs) != 0) {
+                return -1;
+            }
+            if (ops[2][0] != '$') {
+                /* immediate third operand */
+                if (op->alt != NULL) {
+                    return emit_imm_op(st, find_op(op->alt), rd, rs, ops[2]);
+                }
+                if (parse_const(st, ops[2], &value) != 0) {
+                    return -1;
+                }
+                emit_li(st, REG_AT, value);
+                rt = REG_AT;
+            } else if (parse_reg(st, ops[2], &rt) != 0) {
+                return -1;
+            }
+            emit(st, encode_r(rs, rt, rd, 0, op->code));
+            return 0;
+
+        case F_SHIFT:
+            if (expect_operands(st, op->name, n, 3) != 0 ||
+                parse_reg(st, ops[0], &rd) != 0 ||
+                parse_reg(st, ops[1], &rt) != 0 ||
+                parse_const(st, ops[2], &value) != 0) {
+                return -1;
+            }
+            if (value < 0 || value > 31) {
+                return error(st, "shift amount out of range");
+            }
+            emit(st, encode_r(0, rt, rd, (uint32_t)value, op->code));
+            return 0;
+
+        case F_SHIFTV:
+            if (expect_operands(st, op->name, n, 3) != 0 ||
+                parse_reg(st, ops[0], &rd) != 0 ||
+                parse_reg(st, ops[1], &rt) != 0 ||
+                parse_reg(st, ops[2], &rs) != 0) {
+                return -1;
+            }
+            emit(st, encode_r(rs, rt, rd, 0, op->code));
+            return 0;
+
+        case F_JR:
+            if (expect_operands(st, op->name, n, 1) != 0 ||
+                parse_reg(st, ops[0], &rs) != 0) {
+                return -1;
+            }
+            emit(st, encode_r(rs, 0, 0, 0, op->code));
+            return 0;
+
+        case F_JALR:
+            rd = 31;
+            if (n == 1) {
+                if (parse_reg(st, ops[0], &rs) != 0) {
+                    return -1;
+                }
+            } else if (expect_operands(st, op->name, n, 2) != 0 ||
+                       parse_reg(st, ops[0], &rd) != 0 ||
+                       parse_reg(st, ops[1], &rs) != 0) {
+                return -1;
+            }
+            emit(st, encode_r(rs, 0, rd, 0, op->code));
+            return 0;
+
+        case F_MULDIV:
+            if (n == 3 && (op->code == 0x1a || op->code == 0x1b)) {
+                /* div rd, rs, rt => div rs, rt ; mflo rd */
+                if (parse_reg(st, ops[0], &rd) != 0 ||
+                    parse_reg(st, ops[1], &rs) != 0 ||
+                    parse_reg(st, ops[2], &rt) != 0) {
+                    return -1;
+                }
+                emit(st, encode_r(rs, rt, 0, 0, op->code));
+                emit(st, encode_r(0, 0, rd, 0, 0x12));
+                return 0;
+            }
+            if (expect_operands(st, op->name, n, 2) != 0 ||
+                parse_reg(st, ops[0], &rs) != 0 ||
+                parse_reg(st, ops[1], &rt) != 0) {
+                return -1;
+            }
+            emit(st, encode_r(rs, rt, 0, 0, op->code));
+            return 0;
+
+        case F_MF:
+            if (expect_operands(st, op->name, n, 1) != 0 ||
+                parse_reg(st, ops[0], &rd) != 0) {
+                return -1;
+            }
+            emit(st, encode_r(0, 0, rd, 0, op->code));
+            return 0;
+
+        case F_MT:
+            if (expect_operands(st, op->name, n, 1) != 0 ||
+                parse_reg(st, ops[0], &rs) != 0) {
+                return -1;
+            }
+            emit(st, encode_r(rs, 0, 0, 0, op->code));
+            return 0;
+
+        case F_SYSCALL:
+            if (expect_operands(st, op->name, n, 0) != 0) {
+                return -1;
+            }
+            emit(st, op->code);
+            return 0;
+
+        case F_IARITH:
+        case F_ILOGIC:
+            if (expect_operands(st, op->name, n, 3) != 0 ||
+                parse_reg(st, ops[0], &rt) != 0 ||
+                parse_reg(st, ops[1], &rs) != 0) {
+                return -1;
+            }
+            return emit_imm_op(st, op, rt, rs, ops[2]);
+
+        case F_LUI:
+            if (expect_operands(st, op->name, n, 2) != 0 ||
+                parse_reg(st, ops[0], &rt) != 0 ||
+                parse_const(st, ops[1], &value) != 0) {
+                return -1;
+            }
+            if (!fits_unsigned16(value) && !fits_signed16(value)) {
+                return error(st, "immediate out of range");
+            }
+            emit(st, encode_i(op->op, 0, rt, (uint32_t)value));
+            return 0;
+
+        case F_BR2:
+            if (expect_operands(st, op->name, n, 3) != 0 ||
+                parse_reg(st, ops[0], &rs) != 0 ||
+                branch_operand(st, ops[1], &rt) != 0 ||
+                parse_expr(st, ops[2], &expr) != 0) {
+                return -1;
+            }
+            emit_branch(st, op->op, rs, rt, &expr);
+            return 0;
+
+        case F_BR1:
+        case F_REGIMM:
+            if (expect_operands(st, op->name, n, 2) != 0 ||
+                parse_reg(st, ops[0], &rs) != 0 ||
+                parse_expr(st, ops[1], &expr) != 0) {
+                return -1;
+            }
+            emit_branch(st, op->op, rs, op->fmt == F_REGIMM ? op->code : 0,
+                        &expr);
+            return 0;
+
+        case F_MEM:
+            if (expect_operands(st, op->name, n, 2) != 0 ||
+                parse_reg(st, ops[0], &rt) != 0) {
+                return -1;
+            }
+            return emit_mem(st, op->op, rt, ops[1]);
+
+        case F_J:
+            if (expect_operands(st, op->name, n, 1) != 0 ||
+                parse_expr(st, ops[0], &expr) != 0) {
+                return -1;
+            }
+            if (expr.symbol != NULL) {
+                add_fixup(st, FIX_JUMP, &expr);
+                emit(st, op->op << 26);
+            } else {
+                emit(st, (op->op << 26) |
+                             (((uint32_t)expr.value >> 2) & 0x3ffffff));
+            }
+            return 0;
+    }
+    return error(st, "unsupported instruction '%s'", op->name);
+}
+
+/// Compare-and-branch pseudo-instructions: blt, bgt, ble, bge and the
+/// unsigned variants. `slt[u] $at, a, b ; bne/beq $at, $zero, label`
+static int emit_compare_branch(asm_state_t *st, const char *name, char **ops,
+                               int n) {
+    uint32_t rs, rt;
+    asm_expr_t target;
+    int is_unsigned = name[3] == 'u';
+    int swap = name[1] == 'g' ? name[2] == 't' : name[2] == 'e';
+    int on_set = name[2] == 't';
+
+    if (expect_operands(st, name, n, 3) != 0 ||
+        parse_reg(st, ops[0], &rs) != 0 ||
+        branch_operand(st, ops[1], &rt) != 0 ||
+        parse_expr(st, ops[2], &target) != 0) {
+        return -1;
+    }
+    if (swap) {
+        uint32_t tmp = rs;
+        rs = rt;
+        rt = tmp;
+    }
+    emit(st, encode_r(rs, rt, REG_AT, 0, is_unsigned ? 0x2b : 0x2a));
+    emit_branch(st, on_set ? 0x05 : 0x04, REG_AT, 0, &target);
+    return 0;
+}
+
+static int emit_pseudo(asm_state_t *st, const char *name, char **ops, int n,
+                       int *handled) {
+    uint32_t rs, rt, rd;
+    int64_t value = 0;
+    asm_expr_t expr;
+
+    *handled = 1;
+
+    if (strcmp(name, "nop") == 0) {
+        if (expect_operands(st, name, n, 0) != 0) {
+            return -1;
+        }
+        emit(st, 0);
+    } else if (strcmp(name, "move") == 0) {
+        if (expect_operands(st, name, n, 2) != 0 ||
+            parse_reg(st, ops[0], &rd) != 0 ||
+            parse_reg(st, ops[1], &rs) != 0) {
+            return -1;
+        }
+        emit(st, encode_r(0, rs, rd, 0, 0x21));
+    } else if (strcmp(name, "li") == 0) {
+        if (expect_operands(st, name, n, 2) != 0 ||
+            parse_reg(st, ops[0], &rt) != 0 ||
+            parse_const(st, ops[1], &value) != 0) {
+            return -1;
+        }
+        emit_li(st, rt, value);
+    } else if (strcmp(name, "la") == 0) {
+        if (expect_operands(st, name, n, 2) != 0 ||
+            parse_reg(st, ops[0], &rt) != 0 ||
+            parse_expr(st, ops[1], &expr) != 0) {
+            return -1;
+        }
+        if (expr.symbol != NULL) {
+            add_fixup(st, FIX_HI, &expr);
+            emit(st, encode_i(0x0f, 0, REG_AT, 0));
+            add_fixup(st, FIX_LO, &expr);
+            emit(st, encode_i(0x0d, REG_AT, rt, 0));
+        } else {
+            emit(st, encode_i(0x0f, 0, REG_AT, (uint32_t)expr.value >> 16));
+            emit(st, encode_i(0x0d, REG_AT, rt, (uint32_t)expr.value));
+        }
+    } else if (strcmp(name, "not") == 0) {
+        if (expect_operands(st, name, n, 2) != 0 ||
+            parse_reg(st, ops[0], &rd) != 0 ||
+            parse_reg(st, ops[1], &rs) != 0) {
+            return -1;
+        }
+        emit(st, encode_r(rs, 0, rd, 0, 0x27));
+    } else if (strcmp(name, "neg") == 0 || strcmp(name, "negu") == 0) {
+        if (expect_operands(st, name, n, 2) != 0 ||
+            parse_reg(st, ops[0], &rd) != 0 ||
+            parse_reg(st, ops[1], &rt) != 0) {
+            return -1;
+        }
+        emit(st, encode_r(0, rt, rd, 0, name[3] == 'u' ? 0x23 : 0x22));
+    } else if (strcmp(name, "mul") == 0 || strcmp(name, "rem") == 0 ||
+               strcmp(name, "remu") == 0) {
+        /* mult/div rs, rt ; mflo/mfhi rd */
+        int is_mul = name[0] == 'm';
+        if (expect_operands(st, name, n, 3) != 0 ||
+            parse_reg(st, ops[0], &rd) != 0 ||
+            parse_reg(st, ops[1], &rs) != 0 ||
+            parse_reg(st, ops[2], &rt) != 0) {
+            return -1;
+        }
+        emit(st, encode_r(rs, rt, 0, 0,
+                          is_mul ? 0x18 : (name[3] == 'u' ? 0x1b : 0x1a)));
+        emit(st, encode_r(0, 0, rd, 0, is_mul ? 0x12 : 0x10));
+    } else if (strcmp(name, "b") == 0 || strcmp(name, "bal") == 0) {
+        if (expect_operands(st, name, n, 1) != 0 ||
+            parse_expr(st, ops[0], &expr) != 0) {
+            return -1;
+        }
+        if (name[1] == 'a') {
+            emit_branch(st, 0x01, 0, 0x11, &expr);
+        } else {
+            emit_branch(st, 0x04, 0, 0, &expr);
+        }
+    } else if (strcmp(name, "beqz") == 0 || strcmp(name, "bnez") == 0) {
+        if (expect_operands(st, name, n, 2) != 0 ||
+            parse_reg(st, ops[0], &rs) != 0 ||
+            parse_expr(st, ops[1], &expr) != 0) {
+            return -1;
+        }
+        emit_branch(st, name[1] == 'e' ? 0x04 : 0x05, rs, 0, &expr);
+    } else if ((strncmp(name, "blt", 3) == 0 || strncmp(name, "bgt", 3) == 0 ||
+                strncmp(name, "ble", 3) == 0 ||
+                strncmp(name, "bge", 3) == 0) &&
+               (name[3] == '\0' || (name[3] == 'u' && name[4] == '\0'))) {
+        return emit_compare_branch(st, name, ops, n);
+    } else {
+        *handled = 0;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Directives.                                                 */
+/***************************************************************/
+
+static int parse_string(asm_state_t *st, const char *tok, int terminate) {
+    const char *s = tok;
+    if (*s != '"') {
+        return error(st, "expected string literal");
+    }
+    s++;
+    while (*s != '"') {
+        int c;
+        if (parse_char(&s, &c) != 0) {
+            return error(st, "malformed string literal");
+        }
+        uint8_t byte = (uint8_t)c;
+        emit_data(st, &byte, 1);
+    }
+    if (s[1] != '\0') {
+        return error(st, "trailing characters after string");
+    }
+    if (terminate) {
+        uint8_t zero = 0;
+        emit_data(st, &zero, 1);
+    }
+    return 0;
+}
+
+/// .word / .half / .byte, with `value:count` repetition.
+static int emit_values(asm_state_t *st, char *args, uint32_t size) {
+    char *item = args;
+
+    while (item != NULL) {
+        char *next = strchr(item, ',');
+        char *colon;
+        int64_t count = 1;
+        asm_expr_t expr;
+
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        item = trim(item);
+        colon = strchr(item, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            if (parse_const(st, trim(colon + 1), &count) != 0) {
+                return -1;
+            }
+            item = trim(item);
+        }
+        if (parse_expr(st, item, &expr) != 0) {
+            return -1;
+        }
+        while (count-- > 0) {
+            uint32_t v = (uint32_t)expr.value;
+            if (st->seg == SEG_TEXT) {
+                if (size != 4) {
+                    return error(st, "only .word is allowed in .text");
+                }
+                if (expr.symbol != NULL) {
+                    add_fixup(st, FIX_WORD, &expr);
+                }
+                emit(st, v);
+                continue;
+            }
+            if (expr.symbol != NULL) {
+                add_fixup(st, size == 4 ? FIX_WORD
+                                        : (size == 2 ? FIX_HALF : FIX_BYTE),
+                          &expr);
+            }
+            uint8_t bytes[4] = { v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff,
+                                 (v >> 24) & 0xff };
+            emit_data(st, bytes, size);
+        }
+        item = next;
+    }
+    return 0;
+}
+
+static int directive(asm_state_t *st, const char *name, char *args) {
+    int64_t value = 0;
+
+    if (strcmp(name, ".text") == 0 || strcmp(name, ".data") == 0) {
+        args = trim(args);
+        if (*args != '\0') {
+            uint32_t base = name[1] == 't' ? st->prog->text_base
+                                            : st->prog->data_base;
+            uint32_t cur = name[1] == 't' ? text_addr(st) : data_addr(st);
+            if (parse_const(st, args, &value) != 0) {
+                return -1;
+            }
+            if ((uint32_t)value < cur || (uint32_t)value < base) {
+                return error(st, "segment address 0x%08x goes backwards",
+                             (uint32_t)value);
+            }
+            if (name[1] == 't') {
+                if ((value - cur) % 4 != 0) {
+                    return error(st, "unaligned .text address");
+                }
+                while (text_addr(st) < (uint32_t)value) {
+                    emit(st, 0);
+                }
+            } else {
+                emit_data(st, NULL, (uint32_t)value - cur);
+            }
+        }
+        st->seg = name[1] == 't' ? SEG_TEXT : SEG_DATA;
+        return flush_labels(st);
+    }
+
+    if (strcmp(name, ".globl") == 0 || strcmp(name, ".global") == 0 ||
+        strcmp(name, ".extern") == 0 || strcmp(name, ".set") == 0) {
+        return flush_labels(st);
+    }
+
+    if (strcmp(name, ".align") == 0) {
+        if (parse_const(st, trim(args), &value) != 0) {
+            return -1;
+        }
+        if (value < 0 || value > 12) {
+            return error(st, ".align out of range");
+        }
+        if (st->seg == SEG_TEXT) {
+            while (text_addr(st) % (1u << value) != 0) {
+                emit(st, 0);
+            }
+        } else {
+            align_data(st, 1u << value);
+        }
+        return flush_labels(st);
+    }
+
+    if (strcmp(name, ".word") == 0 || strcmp(name, ".half") == 0 ||
+        strcmp(name, ".byte") == 0) {
+        uint32_t size = name[1] == 'w' ? 4 : (name[1] == 'h' ? 2 : 1);
+        if (st->seg == SEG_DATA) {
+            align_data(st, size);
+        }
+        if (flush_labels(st) != 0) {
+            return -1;
+        }
+        return emit_values(st, args, size);
+    }
+
+    if (st->seg != SEG_DATA) {
+        return error(st, "'%s' is only allowed in .data", name);
+    }
+    if (flush_labels(st) != 0) {
+        return -1;
+    }
+
+    if (strcmp(name, ".ascii") == 0 || strcmp(name, ".asciiz") == 0) {
+        char *ops[MAX_OPERANDS];
+        int i, n = split_operands(st, args, ops);
+        if (n <= 0) {
+            return n < 0 ? -1 : error(st, "'%s' expects a string", name);
+        }
+        for (i = 0; i < n; i++) {
+            if (parse_string(st, ops[i], name[6] == 'z') != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (strcmp(name, ".space") == 0) {
+        if (parse_const(st, trim(args), &value) != 0) {
+            return -1;
+        }
+        if (value < 0) {
+            return error(st, ".space size is negative");
+        }
+        emit_data(st, NULL, (uint32_t)value);
+        return 0;
+    }
+
+    return error(st, "unknown directive '%s'", name);
+}
+
+/***************************************************************/
+/* Driver.                                                     */
+/***************************************************************/
+
+static int assemble_line(asm_state_t *st, char *line) {
+    char *s = line;
+    char *q;
+    int quoted = 0;
+
+    /* strip comments, ignoring '#' in string and char literals */
+    for (q = s; *q; q++) {
+        if (*q == '"' && (q == s || q[-1] != '\\')) {
+            quoted = !quoted;
+        } else if (*q == '\'' && !quoted && q[1] != '\0' && q[2] == '\'') {
+            q += 2;
+        } else if (*q == '#' && !quoted) {
+            *q = '\0';
+            break;
+        }
+    }
+
+    st->num_labels = 0;
+    for (;;) {
+        char *start;
+        s = trim(s);
+        if (!is_ident_start(*s) || *s == '$') {
+            break;
+        }
+        start = s;
+        while (is_ident_char(*s)) {
+            s++;
+        }
+        q = s;
+        while (*q == ' ' || *q == '\t') {
+            q++;
+        }
+        if (*q != ':') {
+            s = start;
+            break;
+        }
+        if (st->num_labels == MAX_LINE_LABELS) {
+            return error(st, "too many labels on one line");
+        }
+        *s = '\0';
+        st->labels[st->num_labels++] = start;
+        s = q + 1;
+    }
+
+    if (*s == '\0') {
+        return flush_labels(st);
+    }
+
+    char *name = s;
+    while (*s && !isspace((unsigned char)*s)) {
+        *s = (char)tolower((unsigned char)*s);
+        s++;
+    }
+    if (*s) {
+        *s++ = '\0';
+    }
+
+    if (name[0] == '.') {
+        return directive(st, name, s);
+    }
+
+    if (st->seg != SEG_TEXT) {
+        return error(st, "instruction '%s' outside of .text", name);
+    }
+    if (flush_labels(st) != 0) {
+        return -1;
+    }
+
+    char *ops[MAX_OPERANDS];
+    int n = split_operands(st, s, ops);
+    int handled;
+    if (n < 0) {
+        return -1;
+    }
+
+    const asm_op_t *op = find_op(name);
+    if (op != NULL) {
+        return emit_native(st, op, ops, n);
+    }
+    if (emit_pseudo(st, name, ops, n, &handled) != 0) {
+        return -1;
+    }
+    if (!handled) {
+        return error(st, "unknown instruction '%s'", name);
+    }
+    return 0;
+}
+
+static int resolve_fixups(asm_state_t *st) {
+    asm_program_t *prog = st->prog;
+    uint32_t i;
+
+    for (i = 0; i < st->num_fixups; i++) {
+        asm_fixup_t *fix = &st->fixups[i];
+        const asm_symbol_t *sym = asm_find_symbol(prog, fix->symbol);
+        uint32_t target, pc;
+
+        st->line = fix->line;
+        if (sym == NULL) {
+            return error(st, "undefined label '%s'", fix->symbol);
+        }
+        target = sym->addr + (uint32_t)fix->addend;
+
+        if (fix->seg == SEG_DATA) {
+            uint8_t *p = prog->data + fix->offset;
+            uint32_t size =
+                fix->kind == FIX_WORD ? 4 : (fix->kind == FIX_HALF ? 2 : 1);
+            uint32_t b;
+            for (b = 0; b < size; b++) {
+                p[b] = (target >> (8 * b)) & 0xff;
+            }
+            continue;
+        }
+
+        uint32_t *word = &prog->text[fix->offset];
+        pc = prog->text_base + fix->offset * 4;
+        switch (fix->kind) {
+            case FIX_BRANCH: {
+                int64_t offset = ((int64_t)target - (int64_t)(pc + 4)) / 4;
+                if (!fits_signed16(offset)) {
+                    return error(st, "branch to '%s' is out of range",
+                                 fix->symbol);
+                }
+                *word |= (uint32_t)offset & 0xffff;
+                break;
+            }
+            case FIX_JUMP:
+                if (((pc + 4) & 0xf0000000) != (target & 0xf0000000)) {
+                    return error(st, "jump to '%s' is out of range",
+                                 fix->symbol);
+                }
+                *word |= (target >> 2) & 0x3ffffff;
+                break;
+            case FIX_HI:
+                *word |= target >> 16;
+                break;
+            case FIX_HI_ADJ:
+                *word |= ((target + 0x8000) >> 16) & 0xffff;
+                break;
+            case FIX_LO:
+                *word |= target & 0xffff;
+                break;
+            case FIX_WORD:
+                *word = target;
+                break;
+            default:
+                return error(st, "invalid relocation in .text");
+        }
+    }
+    return 0;
+}
+
+int asm_assemble(asm_program_t *prog, const char *source, size_t len,
+                 uint32_t text_base, uint32_t data_base) {
+    asm_state_t st;
+    char *buf = NULL;
+    size_t buf_cap = 0;
+    size_t pos = 0;
+    int ret = 0;
+
+    memset(prog, 0, sizeof(*prog));
+    prog->text_base = text_base;
+    prog->data_base = data_base;
+
+    memset(&st, 0, sizeof(st));
+    st.prog = prog;
+    st.seg = SEG_TEXT;
+
+    while (pos < len) {
+        const char *nl = memchr(source + pos, '\n', len - pos);
+        size_t line_len = nl ? (size_t)(nl - (source + pos)) : len - pos;
+
+        if (line_len + 1 > buf_cap) {
+            buf_cap = line_len + 1 > 256 ? line_len + 1 : 256;
+            buf = realloc(buf, buf_cap);
+        }
+        memcpy(buf, source + pos, line_len);
+        buf[line_len] = '\0';
+        pos += line_len + 1;
+        st.line++;
+
+        if (assemble_line(&st, buf) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret == 0) {
+        ret = resolve_fixups(&st);
+    }
+
+    free(buf);
+    free(st.fixups);
+    return ret;
+}
+
+int asm_assemble_file(asm_program_t *prog, const char *filename,
+                      uint32_t text_base, uint32_t data_base) {
+    FILE *file = fopen(filename, "rb");
+    char *source;
+    long size;
+    int ret;
+
+    if (file == NULL) {
+        memset(prog, 0, sizeof(*prog));
+        snprintf(prog->error, sizeof(prog->error), "can't open %s", filename);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    source = malloc(size > 0 ? size : 1);
+    if (fread(source, 1, size, file) != (size_t)size) {
+        fclose(file);
+        free(source);
+        memset(prog, 0, sizeof(*prog));
+        snprintf(prog->error, sizeof(prog->error), "can't read %s", filename);
+        return -1;
+    }
+    fclose(file);
+
+    ret = asm_assemble(prog, source, size, text_base, data_base);
+    free(source);
+    return ret;
+}
+
+void asm_free(asm_program_t *prog) {
+    while (prog->names != NULL) {
+        char *prev;
+        memcpy(&prev, prog->names, sizeof(char *));
+        free(prog->names);
+        prog->names = prev;
+    }
+    free(prog->text);
+    free(prog->text_lines);
+    free(prog->data);
+    free(prog->symbols);
+    free(prog->symbol_index);
+    memset(prog, 0, sizeof(*prog));
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const asm_symbol_t *lhs = a, *rhs = b;
+    if (lhs->addr != rhs->addr) {
+        return lhs->addr < rhs->addr ? -1 : 1;
+    }
+    return strcmp(lhs->name, rhs->name);
+}
+
+void asm_write_symbols(const asm_program_t *prog, FILE *out) {
+    asm_symbol_t *sorted = malloc((prog->num_symbols + 1) * sizeof(*sorted));
+    uint32_t i;
+
+    memcpy(sorted, prog->symbols, prog->num_symbols * sizeof(*sorted));
+    qsort(sorted, prog->num_symbols, sizeof(*sorted), compare_symbols);
+    for (i = 0; i < prog->num_symbols; i++) {
+        fprintf(out, "0x%08x %s\n", sorted[i].addr, sorted[i].name);
+    }
+    free(sorted);
+}
+
+void asm_write_hex(const asm_program_t *prog, FILE *out) {
+    uint32_t i;
+    for (i = 0; i < prog->text_len; i++) {
+        fprintf(out, "%08x\n", prog->text[i]);
+    }
+}
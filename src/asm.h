@@ -0,0 +1,72 @@
+#ifndef _SIM_ASM_H_
+#define _SIM_ASM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Default segment bases, matching the simulator's memory map.
+#define ASM_TEXT_BASE 0x00400000
+#define ASM_DATA_BASE 0x10000000
+
+typedef struct {
+    const char *name;
+    uint32_t addr;
+} asm_symbol_t;
+
+/// Result of assembling one source file.
+///
+/// `text` holds instruction words starting at `text_base` and `data` holds raw
+/// bytes starting at `data_base`. `text_lines` maps every text word back to
+/// the source line it was generated from (pseudo-instructions expand to
+/// several words sharing one line).
+typedef struct {
+    uint32_t text_base;
+    uint32_t *text;
+    uint32_t *text_lines;
+    uint32_t text_len, text_cap;
+
+    uint32_t data_base;
+    uint8_t *data;
+    uint32_t data_len, data_cap;
+
+    asm_symbol_t *symbols;
+    uint32_t num_symbols, symbols_cap;
+
+    /* open addressing hash over `symbols`, stores index + 1 */
+    uint32_t *symbol_index;
+    uint32_t symbol_index_cap;
+
+    char *names;
+    size_t names_len, names_cap;
+
+    char error[256];
+} asm_program_t;
+
+/// Assemble `len` bytes of source text with .text at `text_base` and .data
+/// at `data_base` (ASM_TEXT_BASE and ASM_DATA_BASE for the default memory
+/// map). Returns 0 on success; on failure returns -1 and leaves a message
+/// with the line number in `prog->error`.
+int asm_assemble(asm_program_t *prog, const char *source, size_t len,
+                 uint32_t text_base, uint32_t data_base);
+
+/// Read and assemble a file.
+int asm_assemble_file(asm_program_t *prog, const char *filename,
+                      uint32_t text_base, uint32_t data_base);
+
+void asm_free(asm_program_t *prog);
+
+/// Conventional register names, "zero" to "ra".
+extern const char *const ASM_REG_NAMES[32];
+
+/// Look up a label, returns NULL if it is not defined.
+const asm_symbol_t *asm_find_symbol(const asm_program_t *prog,
+                                    const char *name);
+
+/// Print the symbol map sorted by address.
+void asm_write_symbols(const asm_program_t *prog, FILE *out);
+
+/// Write the text segment in the `.x` format (one hex word per line).
+void asm_write_hex(const asm_program_t *prog, FILE *out);
+
+#endif
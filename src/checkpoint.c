@@ -0,0 +1,215 @@
+#include "checkpoint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+#include "syscall.h"
+
+typedef struct {
+    uint32_t addr;
+    uint8_t *data;
+} page_delta_t;
+
+typedef struct {
+    uint64_t count;
+    CPU_State state;
+    int run_bit, faulted;
+    uint32_t heap_break;
+
+    /* pre-images of the pages written after this checkpoint */
+    page_delta_t *pages;
+    uint32_t num_pages, pages_cap;
+} checkpoint_t;
+
+uint64_t CHECKPOINT_INTERVAL;
+
+static checkpoint_t *checkpoints;
+static uint32_t num_checkpoints, checkpoints_cap;
+
+static uint64_t max_bytes, used_bytes;
+
+/* pages already saved since the latest checkpoint, stored as page + 1 */
+static uint32_t *saved;
+static uint32_t saved_cap, saved_count;
+
+static void free_deltas(checkpoint_t *cp) {
+    uint32_t i;
+    for (i = 0; i < cp->num_pages; i++) {
+        free(cp->pages[i].data);
+    }
+    used_bytes -= (uint64_t)cp->num_pages * CHECKPOINT_PAGE_SIZE;
+    free(cp->pages);
+    cp->pages = NULL;
+    cp->num_pages = cp->pages_cap = 0;
+}
+
+/// Copy the saved pages of `cp` back into memory.
+static void undo_deltas(checkpoint_t *cp) {
+    uint32_t i, avail;
+    for (i = cp->num_pages; i-- > 0;) {
+        uint8_t *mem = mem_ptr(cp->pages[i].addr, &avail);
+        memcpy(mem, cp->pages[i].data, CHECKPOINT_PAGE_SIZE);
+    }
+}
+
+static void clear_saved(void) {
+    if (saved != NULL) {
+        memset(saved, 0, saved_cap * sizeof(uint32_t));
+    }
+    saved_count = 0;
+}
+
+/// Insert into the saved set, returns 0 if the page was already there.
+static int mark_saved(uint32_t page) {
+    uint32_t i, mask;
+
+    if ((saved_count + 1) * 2 > saved_cap) {
+        uint32_t *old = saved, old_cap = saved_cap;
+        saved_cap = saved_cap ? saved_cap * 2 : 256;
+        saved = calloc(saved_cap, sizeof(uint32_t));
+        saved_count = 0;
+        for (i = 0; i < old_cap; i++) {
+            if (old[i] != 0) {
+                mark_saved(old[i] - 1);
+            }
+        }
+        free(old);
+    }
+
+    mask = saved_cap - 1;
+    for (i = (page * 2654435761u) & mask; saved[i] != 0; i = (i + 1) & mask) {
+        if (saved[i] == page + 1) {
+            return 0;
+        }
+    }
+    saved[i] = page + 1;
+    saved_count++;
+    return 1;
+}
+
+static void drop_oldest(void) {
+    free_deltas(&checkpoints[0]);
+    memmove(&checkpoints[0], &checkpoints[1],
+            (num_checkpoints - 1) * sizeof(checkpoint_t));
+    num_checkpoints--;
+}
+
+static void take(void) {
+    checkpoint_t *cp;
+
+    if (num_checkpoints == checkpoints_cap) {
+        checkpoints_cap = checkpoints_cap ? checkpoints_cap * 2 : 64;
+        checkpoints =
+            realloc(checkpoints, checkpoints_cap * sizeof(checkpoint_t));
+    }
+    cp = &checkpoints[num_checkpoints++];
+    memset(cp, 0, sizeof(*cp));
+    cp->count = INSTRUCTION_COUNT;
+    cp->state = CURRENT_STATE;
+    cp->run_bit = RUN_BIT;
+    cp->faulted = FAULTED;
+    cp->heap_break = syscall_break();
+    clear_saved();
+}
+
+void checkpoint_reset(void) {
+    while (num_checkpoints > 0) {
+        free_deltas(&checkpoints[--num_checkpoints]);
+    }
+    clear_saved();
+    /* history starts again here, no earlier call will be replayed */
+    syscall_forget(0);
+    if (CHECKPOINT_INTERVAL != 0) {
+        take();
+    }
+}
+
+void checkpoint_configure(uint64_t interval, uint64_t max) {
+    CHECKPOINT_INTERVAL = 0;
+    checkpoint_reset();
+    CHECKPOINT_INTERVAL = interval;
+    max_bytes = max;
+    checkpoint_reset();
+}
+
+uint64_t checkpoint_next(void) {
+    return checkpoints[num_checkpoints - 1].count + CHECKPOINT_INTERVAL;
+}
+
+void checkpoint_maybe_take(void) {
+    if (CHECKPOINT_INTERVAL != 0 && INSTRUCTION_COUNT >= checkpoint_next()) {
+        take();
+    }
+}
+
+static void save_page(uint32_t page) {
+    checkpoint_t *cp = &checkpoints[num_checkpoints - 1];
+    uint32_t avail;
+    uint8_t *mem = mem_ptr(page << CHECKPOINT_PAGE_SHIFT, &avail);
+
+    if (mem == NULL || avail < CHECKPOINT_PAGE_SIZE || !mark_saved(page)) {
+        return;
+    }
+    if (cp->num_pages == cp->pages_cap) {
+        cp->pages_cap = cp->pages_cap ? cp->pages_cap * 2 : 16;
+        cp->pages = realloc(cp->pages, cp->pages_cap * sizeof(page_delta_t));
+    }
+    cp->pages[cp->num_pages].addr = page << CHECKPOINT_PAGE_SHIFT;
+    cp->pages[cp->num_pages].data = malloc(CHECKPOINT_PAGE_SIZE);
+    memcpy(cp->pages[cp->num_pages].data, mem, CHECKPOINT_PAGE_SIZE);
+    cp->num_pages++;
+    used_bytes += CHECKPOINT_PAGE_SIZE;
+
+    /* the latest checkpoint is always kept, even over budget */
+    while (used_bytes > max_bytes && num_checkpoints > 1) {
+        drop_oldest();
+    }
+}
+
+void checkpoint_write_hook(uint32_t address) {
+    uint32_t first = address >> CHECKPOINT_PAGE_SHIFT;
+    uint32_t last = (address + 3) >> CHECKPOINT_PAGE_SHIFT;
+
+    save_page(first);
+    if (last != first) {
+        save_page(last);
+    }
+}
+
+int checkpoint_restore(uint64_t count) {
+    uint32_t target, i;
+
+    if (num_checkpoints == 0 || checkpoints[0].count > count) {
+        return -1;
+    }
+    target = num_checkpoints - 1;
+    while (checkpoints[target].count > count) {
+        target--;
+    }
+
+    /* undo newest first, so each page ends up as it was at `target` */
+    for (i = num_checkpoints; i-- > target;) {
+        undo_deltas(&checkpoints[i]);
+        free_deltas(&checkpoints[i]);
+    }
+    num_checkpoints = target + 1;
+    clear_saved();
+
+    CURRENT_STATE = checkpoints[target].state;
+    NEXT_STATE = CURRENT_STATE;
+    RUN_BIT = checkpoints[target].run_bit;
+    FAULTED = checkpoints[target].faulted;
+    syscall_set_break(checkpoints[target].heap_break);
+    INSTRUCTION_COUNT = checkpoints[target].count;
+    return 0;
+}
+
+uint64_t checkpoint_oldest(void) {
+    return num_checkpoints ? checkpoints[0].count : 0;
+}
+
+void checkpoint_stats(uint32_t *count, uint64_t *bytes) {
+    *count = num_checkpoints;
+    *bytes = used_bytes;
+}
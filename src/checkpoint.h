@@ -0,0 +1,43 @@
+#ifndef _SIM_CHECKPOINT_H_
+#define _SIM_CHECKPOINT_H_
+
+#include <stdint.h>
+
+/// Checkpoints hold the registers at a given instruction count, plus the
+/// original contents of every page written until the next checkpoint. Going
+/// back to checkpoint k undoes the page deltas of all later checkpoints, so
+/// a reverse step only re-executes up to one interval.
+#define CHECKPOINT_PAGE_SHIFT 12
+#define CHECKPOINT_PAGE_SIZE (1u << CHECKPOINT_PAGE_SHIFT)
+
+/// Instructions between checkpoints, 0 when disabled.
+extern uint64_t CHECKPOINT_INTERVAL;
+
+/// Enable checkpoints every `interval` instructions keeping at most
+/// `max_bytes` of saved pages, dropping the oldest checkpoints beyond that.
+/// Discards any history and takes the first checkpoint at the current state.
+void checkpoint_configure(uint64_t interval, uint64_t max_bytes);
+
+/// Forget all history and start again from the current state, for changes
+/// made outside of execution (e.g. editing registers from the shell).
+void checkpoint_reset(void);
+
+/// Instruction count at which the next checkpoint is due.
+uint64_t checkpoint_next(void);
+
+/// Take a checkpoint if one is due at the current instruction count.
+void checkpoint_maybe_take(void);
+
+/// Called by mem_write_32 before modifying memory.
+void checkpoint_write_hook(uint32_t address);
+
+/// Restore the latest checkpoint taken at or before `count`, discarding
+/// newer ones. Returns -1 if history does not reach back that far.
+int checkpoint_restore(uint64_t count);
+
+/// Instruction count of the oldest checkpoint still kept.
+uint64_t checkpoint_oldest(void);
+
+void checkpoint_stats(uint32_t *checkpoints, uint64_t *bytes);
+
+#endif
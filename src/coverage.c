@@ -0,0 +1,268 @@
+#include "coverage.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "isa.h"
+#include "shell.h"
+
+#define COVERAGE_MAGIC "MIPSCOV2"
+#define COVERAGE_HASH_SEED 0x811c9dc5u
+#define COVERAGE_HASH_PRIME 0x01000193u
+
+coverage_t COVERAGE;
+const char *COVERAGE_OUTPUT;
+uint32_t COVERAGE_FROM = 1;
+uint64_t COVERAGE_SEEN[COVERAGE_SEEN_SIZE];
+
+static uint32_t bitmap_words(uint32_t text_words) {
+    return (text_words + 31) / 32;
+}
+
+static uint32_t hash_word(uint32_t hash, uint32_t word) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        hash = (hash ^ ((word >> (8 * i)) & 0xff)) * COVERAGE_HASH_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t edge_slot(uint64_t key, uint32_t cap) {
+    return (uint32_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (cap - 1);
+}
+
+static void insert_key(coverage_t *cov, uint64_t key) {
+    uint32_t i;
+
+    if ((cov->num_edges + 1) * 2 > cov->edges_cap) {
+        uint64_t *old = cov->edges;
+        uint32_t old_cap = cov->edges_cap;
+
+        cov->edges_cap = old_cap ? old_cap * 2 : 256;
+        cov->edges = calloc(cov->edges_cap, sizeof(uint64_t));
+        cov->num_edges = 0;
+        for (i = 0; i < old_cap; i++) {
+            if (old[i] != 0) {
+                insert_key(cov, old[i]);
+            }
+        }
+        free(old);
+    }
+    for (i = edge_slot(key, cov->edges_cap); cov->edges[i] != 0;
+         i = (i + 1) & (cov->edges_cap - 1)) {
+        if (cov->edges[i] == key) {
+            return;
+        }
+    }
+    cov->edges[i] = key;
+    cov->num_edges++;
+}
+
+static uint64_t edge_key(uint32_t from, uint32_t to) {
+    return ((uint64_t)from << 32) | to | 1;
+}
+
+void coverage_add_edge(coverage_t *cov, uint32_t from, uint32_t to) {
+    insert_key(cov, edge_key(from, to));
+}
+
+int coverage_has_edge(const coverage_t *cov, uint32_t from, uint32_t to) {
+    uint64_t key = edge_key(from, to);
+    uint32_t i;
+
+    if (cov->edges_cap == 0) {
+        return 0;
+    }
+    for (i = edge_slot(key, cov->edges_cap); cov->edges[i] != 0;
+         i = (i + 1) & (cov->edges_cap - 1)) {
+        if (cov->edges[i] == key) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void save_at_exit(void) {
+    if (coverage_save(&COVERAGE, COVERAGE_OUTPUT) != 0) {
+        fprintf(stderr, "Error: Can't write coverage to %s\n",
+                COVERAGE_OUTPUT);
+    }
+}
+
+void coverage_start(const char *output, uint32_t base, uint32_t words) {
+    uint32_t i;
+
+    coverage_free(&COVERAGE);
+    COVERAGE.text_base = base;
+    COVERAGE.text_words = words;
+    COVERAGE.text_hash = COVERAGE_HASH_SEED;
+    for (i = 0; i < words; i++) {
+        COVERAGE.text_hash = hash_word(COVERAGE.text_hash,
+                                       mem_read_32(base + i * 4));
+    }
+    COVERAGE.bits = calloc(bitmap_words(words) + 1, sizeof(uint32_t));
+    COVERAGE.runs = 1;
+    COVERAGE_FROM = 1;
+    memset(COVERAGE_SEEN, 0, sizeof(COVERAGE_SEEN));
+    if (COVERAGE_OUTPUT == NULL) {
+        atexit(save_at_exit);
+    }
+    COVERAGE_OUTPUT = output;
+}
+
+int coverage_save(const coverage_t *cov, const char *filename) {
+    uint32_t header[5] = { cov->text_base, cov->text_words, cov->text_hash,
+                           cov->num_edges, cov->runs };
+    uint32_t i, pair[2];
+    FILE *out;
+
+    if ((out = fopen(filename, "wb")) == NULL) {
+        return -1;
+    }
+    fwrite(COVERAGE_MAGIC, 1, 8, out);
+    fwrite(header, sizeof(uint32_t), 5, out);
+    fwrite(cov->bits, sizeof(uint32_t), bitmap_words(cov->text_words), out);
+    for (i = 0; i < cov->edges_cap; i++) {
+        if (cov->edges[i] != 0) {
+            pair[0] = cov->edges[i] >> 32;
+            pair[1] = (uint32_t)cov->edges[i] & ~1u;
+            fwrite(pair, sizeof(uint32_t), 2, out);
+        }
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+int coverage_load(coverage_t *cov, const char *filename) {
+    uint32_t header[5], i, n, pair[2];
+    uint32_t *bits;
+    char magic[8];
+    FILE *in;
+
+    if ((in = fopen(filename, "rb")) == NULL) {
+        fprintf(stderr, "Error: Can't open %s\n", filename);
+        return -1;
+    }
+    if (fread(magic, 1, 8, in) != 8 ||
+        memcmp(magic, COVERAGE_MAGIC, 8) != 0 ||
+        fread(header, sizeof(uint32_t), 5, in) != 5) {
+        fprintf(stderr, "Error: %s is not a coverage file\n", filename);
+        fclose(in);
+        return -1;
+    }
+    if (cov->bits != NULL && cov->text_base != header[0]) {
+        fprintf(stderr, "Error: %s covers text at 0x%08x, not 0x%08x\n",
+                filename, header[0], cov->text_base);
+        fclose(in);
+        return -1;
+    }
+    if (cov->bits != NULL &&
+        (cov->text_words != header[1] || cov->text_hash != header[2])) {
+        fprintf(stderr, "Error: %s is coverage of another program\n",
+                filename);
+        fclose(in);
+        return -1;
+    }
+
+    n = bitmap_words(header[1]);
+    bits = malloc((n + 1) * sizeof(uint32_t));
+    if (fread(bits, sizeof(uint32_t), n, in) != n) {
+        fprintf(stderr, "Error: %s is truncated\n", filename);
+        free(bits);
+        fclose(in);
+        return -1;
+    }
+    if (cov->bits == NULL) {
+        cov->text_base = header[0];
+        cov->text_words = header[1];
+        cov->text_hash = header[2];
+        cov->bits = bits;
+    } else {
+        for (i = 0; i < n; i++) {
+            cov->bits[i] |= bits[i];
+        }
+        free(bits);
+    }
+    cov->runs += header[4];
+
+    for (i = 0; i < header[3]; i++) {
+        if (fread(pair, sizeof(uint32_t), 2, in) != 2) {
+            fprintf(stderr, "Error: %s is truncated\n", filename);
+            fclose(in);
+            return -1;
+        }
+        coverage_add_edge(cov, pair[0], pair[1]);
+    }
+    fclose(in);
+    return 0;
+}
+
+void coverage_free(coverage_t *cov) {
+    free(cov->bits);
+    free(cov->edges);
+    memset(cov, 0, sizeof(*cov));
+}
+
+static int word_hit(const coverage_t *cov, uint32_t addr) {
+    uint32_t word = (addr - cov->text_base) >> 2;
+    return word < cov->text_words &&
+           ((cov->bits[word >> 5] >> (word & 31)) & 1);
+}
+
+int coverage_report(const coverage_t *cov, const asm_program_t *prog,
+                    const char *source, FILE *out) {
+    uint32_t i, line, pc, inst, target, lines = 0, lines_hit = 0;
+    uint32_t branches = 0, branches_hit = 0, hash;
+    int hit, taken, not_taken;
+
+    hash = COVERAGE_HASH_SEED;
+    for (i = 0; i < prog->text_len; i++) {
+        hash = hash_word(hash, prog->text[i]);
+    }
+    if (prog->text_base != cov->text_base ||
+        prog->text_len != cov->text_words || hash != cov->text_hash) {
+        return -1;
+    }
+    fprintf(out, "TN:\nSF:%s\n", source);
+
+    /* one DA record per line, covered if any of its words ran */
+    for (i = 0; i < prog->text_len; i = line) {
+        hit = 0;
+        for (line = i; line < prog->text_len &&
+                       prog->text_lines[line] == prog->text_lines[i];
+             line++) {
+            hit |= word_hit(cov, prog->text_base + line * 4);
+        }
+        fprintf(out, "DA:%u,%d\n", prog->text_lines[i], hit);
+        lines++;
+        lines_hit += hit;
+    }
+
+    for (i = 0; i < prog->text_len; i++) {
+        pc = prog->text_base + i * 4;
+        inst = prog->text[i];
+        if (ISA_INFO[isa_decode(inst)].kind != ISA_KIND_BRANCH) {
+            continue;
+        }
+        target = pc + 4 + (sign_ext(extract_imm(inst)) << 2);
+        if (!word_hit(cov, pc)) {
+            fprintf(out, "BRDA:%u,%u,0,-\nBRDA:%u,%u,1,-\n",
+                    prog->text_lines[i], i, prog->text_lines[i], i);
+        } else {
+            taken = coverage_has_edge(cov, pc, target);
+            not_taken = coverage_has_edge(cov, pc, pc + 4);
+            fprintf(out, "BRDA:%u,%u,0,%d\nBRDA:%u,%u,1,%d\n",
+                    prog->text_lines[i], i, taken, prog->text_lines[i], i,
+                    not_taken);
+            branches_hit += taken + not_taken;
+        }
+        branches += 2;
+    }
+
+    fprintf(out, "BRF:%u\nBRH:%u\nLF:%u\nLH:%u\nend_of_record\n", branches,
+            branches_hit, lines, lines_hit);
+    fprintf(stderr, "%s: %u/%u lines, %u/%u branch directions, %u runs\n",
+            source, lines_hit, lines, branches_hit, branches, cov->runs);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _SIM_COVERAGE_H_
+#define _SIM_COVERAGE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "asm.h"
+
+/// Guest code coverage: one bit per word of the program text, set when the
+/// word executes, and the set of control flow edges taken, keyed by
+/// (branch or jump address, next PC) in an open addressing table.
+///
+/// Files are a header, the bitmap and the edges, in host byte order:
+///
+///   "MIPSCOV2", text base, text words, text hash,   (5 x uint32)
+///   edges, runs
+///   (text words + 31) / 32 bitmap words             (uint32)
+///   edges x (from, to)                              (2 x uint32)
+///
+/// The text hash is FNV-1a over the text words, so that coverage of one
+/// program is never merged with or reported against another. Merging ORs
+/// the bitmaps and unions the edges, so it is linear in the size of the
+/// files.
+typedef struct {
+    uint32_t text_base, text_words, text_hash;
+    uint32_t *bits;
+
+    /* (from << 32 | to | 1), 0 when free */
+    uint64_t *edges;
+    uint32_t edges_cap, num_edges;
+
+    uint32_t runs;
+} coverage_t;
+
+/// The coverage of the running program, written to COVERAGE_OUTPUT at exit.
+extern coverage_t COVERAGE;
+extern const char *COVERAGE_OUTPUT;
+
+/// Address of the last instruction if it was a branch or jump, else 1.
+extern uint32_t COVERAGE_FROM;
+
+/// Edges recently added, direct mapped, so hot loops skip the table.
+#define COVERAGE_SEEN_SIZE 1024
+extern uint64_t COVERAGE_SEEN[COVERAGE_SEEN_SIZE];
+
+/// Start collecting for the loaded text words at [base, base + 4 * words),
+/// saving to `output` when the simulator exits.
+void coverage_start(const char *output, uint32_t base, uint32_t words);
+
+void coverage_add_edge(coverage_t *cov, uint32_t from, uint32_t to);
+int coverage_has_edge(const coverage_t *cov, uint32_t from, uint32_t to);
+
+int coverage_save(const coverage_t *cov, const char *filename);
+
+/// Read a file into `cov`, or merge it in if `cov` already holds coverage of
+/// the same text. Returns -1 with a message on stderr on failure.
+int coverage_load(coverage_t *cov, const char *filename);
+
+void coverage_free(coverage_t *cov);
+
+/// Write `cov` for the program assembled from `source` as an lcov tracefile:
+/// DA records for every source line with code and BRDA records for both
+/// directions of every conditional branch. Returns -1 if the coverage is not
+/// of this program.
+int coverage_report(const coverage_t *cov, const asm_program_t *prog,
+                    const char *source, FILE *out);
+
+/// Called before every instruction of the coverage interpreter.
+static inline void coverage_hit(uint32_t pc, int control) {
+    uint32_t word = (pc - COVERAGE.text_base) >> 2;
+
+    if (COVERAGE_FROM != 1) {
+        uint64_t key = ((uint64_t)COVERAGE_FROM << 32) | pc | 1;
+        uint32_t slot = (COVERAGE_FROM ^ (pc >> 2)) & (COVERAGE_SEEN_SIZE - 1);
+        uint64_t *seen = &COVERAGE_SEEN[slot];
+
+        if (*seen != key) {
+            *seen = key;
+            coverage_add_edge(&COVERAGE, COVERAGE_FROM, pc);
+        }
+    }
+    COVERAGE_FROM = control ? pc : 1;
+    if (word < COVERAGE.text_words) {
+        COVERAGE.bits[word >> 5] |= 1u << (word & 31);
+    }
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG_NPAGES (1u << (32 - DEBUG_PAGE_SHIFT))
+
+typedef struct {
+    uint32_t addr; /* word aligned */
+    int kind;
+} watchpoint_t;
+
+int NUM_BREAKPOINTS;
+int NUM_WATCHPOINTS;
+
+uint32_t **BREAK_PAGES;
+uint8_t *WATCH_PAGES;
+
+int WATCH_TRIGGERED;
+int WATCH_HIT_KIND;
+uint32_t WATCH_HIT_ADDR;
+
+/* sorted list, for insertion, removal and listing */
+static uint32_t *breakpoints;
+static int breakpoints_cap;
+
+static watchpoint_t *watchpoints;
+static int watchpoints_cap;
+
+static uint32_t page_of(uint32_t addr) { return addr >> DEBUG_PAGE_SHIFT; }
+
+/// Index of the first breakpoint >= addr.
+static int break_lower_bound(uint32_t addr) {
+    int lo = 0, hi = NUM_BREAKPOINTS;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (breakpoints[mid] < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/// Set or clear the bit of `addr` in its page bitmap.
+static void break_mark(uint32_t addr, int set) {
+    uint32_t **page = &BREAK_PAGES[page_of(addr)];
+    uint32_t word = (addr >> 7) & ((1u << (DEBUG_PAGE_SHIFT - 7)) - 1);
+
+    if (*page == NULL) {
+        *page = calloc(1u << (DEBUG_PAGE_SHIFT - 7), sizeof(uint32_t));
+    }
+    if (set) {
+        (*page)[word] |= 1u << ((addr >> 2) & 31);
+    } else {
+        (*page)[word] &= ~(1u << ((addr >> 2) & 31));
+    }
+}
+
+int break_insert(uint32_t addr) {
+    int i;
+
+    addr &= ~3u;
+    if (BREAK_PAGES == NULL) {
+        BREAK_PAGES = calloc(DEBUG_NPAGES, sizeof(uint32_t *));
+    }
+    i = break_lower_bound(addr);
+    if (i < NUM_BREAKPOINTS && breakpoints[i] == addr) {
+        return -1;
+    }
+    if (NUM_BREAKPOINTS == breakpoints_cap) {
+        breakpoints_cap = breakpoints_cap ? breakpoints_cap * 2 : 16;
+        breakpoints = realloc(breakpoints, breakpoints_cap * sizeof(uint32_t));
+    }
+    memmove(&breakpoints[i + 1], &breakpoints[i],
+            (NUM_BREAKPOINTS - i) * sizeof(uint32_t));
+    breakpoints[i] = addr;
+    NUM_BREAKPOINTS++;
+    break_mark(addr, 1);
+    return 0;
+}
+
+int break_remove(uint32_t addr) {
+    int i;
+
+    addr &= ~3u;
+    i = break_lower_bound(addr);
+    if (i >= NUM_BREAKPOINTS || breakpoints[i] != addr) {
+        return -1;
+    }
+    memmove(&breakpoints[i], &breakpoints[i + 1],
+            (NUM_BREAKPOINTS - i - 1) * sizeof(uint32_t));
+    NUM_BREAKPOINTS--;
+
+    /* neighbours are the only candidates left on the same page */
+    break_mark(addr, 0);
+    if ((i == 0 || page_of(breakpoints[i - 1]) != page_of(addr)) &&
+        (i == NUM_BREAKPOINTS || page_of(breakpoints[i]) != page_of(addr))) {
+        free(BREAK_PAGES[page_of(addr)]);
+        BREAK_PAGES[page_of(addr)] = NULL;
+    }
+    return 0;
+}
+
+static void watch_mark_page(uint32_t page) {
+    int i;
+    WATCH_PAGES[page] = 0;
+    for (i = 0; i < NUM_WATCHPOINTS; i++) {
+        if (page_of(watchpoints[i].addr) == page) {
+            WATCH_PAGES[page] = 1;
+        }
+    }
+}
+
+int watch_insert(uint32_t addr, int kind) {
+    int i;
+
+    addr &= ~3u;
+    if (WATCH_PAGES == NULL) {
+        WATCH_PAGES = calloc(DEBUG_NPAGES, 1);
+    }
+    for (i = 0; i < NUM_WATCHPOINTS; i++) {
+        if (watchpoints[i].addr == addr) {
+            watchpoints[i].kind = kind;
+            return 0;
+        }
+    }
+    if (NUM_WATCHPOINTS == watchpoints_cap) {
+        watchpoints_cap = watchpoints_cap ? watchpoints_cap * 2 : 8;
+        watchpoints =
+            realloc(watchpoints, watchpoints_cap * sizeof(watchpoint_t));
+    }
+    watchpoints[NUM_WATCHPOINTS].addr = addr;
+    watchpoints[NUM_WATCHPOINTS].kind = kind;
+    NUM_WATCHPOINTS++;
+    WATCH_PAGES[page_of(addr)] = 1;
+    return 0;
+}
+
+int watch_remove(uint32_t addr) {
+    int i;
+
+    addr &= ~3u;
+    for (i = 0; i < NUM_WATCHPOINTS; i++) {
+        if (watchpoints[i].addr == addr) {
+            watchpoints[i] = watchpoints[--NUM_WATCHPOINTS];
+            watch_mark_page(page_of(addr));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void watch_check(uint32_t addr, uint32_t size, int kind) {
+    uint32_t last = addr + size - 1;
+    int i;
+
+    if (!WATCH_PAGES[page_of(addr)] && !WATCH_PAGES[page_of(last)]) {
+        return;
+    }
+    for (i = 0; i < NUM_WATCHPOINTS; i++) {
+        uint32_t start = watchpoints[i].addr;
+        if ((watchpoints[i].kind & kind) && addr <= start + 3 &&
+            last >= start) {
+            WATCH_TRIGGERED = 1;
+            WATCH_HIT_KIND = kind;
+            WATCH_HIT_ADDR = addr;
+            return;
+        }
+    }
+}
+
+void debug_list(FILE *out) {
+    int i;
+
+    if (NUM_BREAKPOINTS == 0 && NUM_WATCHPOINTS == 0) {
+        fprintf(out, "No breakpoints or watchpoints\n");
+        return;
+    }
+    for (i = 0; i < NUM_BREAKPOINTS; i++) {
+        fprintf(out, "break 0x%08x\n", breakpoints[i]);
+    }
+    for (i = 0; i < NUM_WATCHPOINTS; i++) {
+        int kind = watchpoints[i].kind;
+        fprintf(out, "watch 0x%08x %s\n", watchpoints[i].addr,
+                kind == (WATCH_READ | WATCH_WRITE)
+                    ? "rw"
+                    : (kind == WATCH_READ ? "r" : "w"));
+    }
+}
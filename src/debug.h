@@ -0,0 +1,57 @@
+#ifndef _SIM_DEBUG_H_
+#define _SIM_DEBUG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/// Breakpoints and watchpoints are looked up by 4 KB page first, so code
+/// and data on pages without any cost a single load per check.
+#define DEBUG_PAGE_SHIFT 12
+
+#define WATCH_READ  1
+#define WATCH_WRITE 2
+
+extern int NUM_BREAKPOINTS;
+extern int NUM_WATCHPOINTS;
+
+/// Breakpoints: per page, NULL or a bitmap with one bit per word. The page
+/// table is allocated with the first entry.
+extern uint32_t **BREAK_PAGES;
+
+/// Watchpoints: one flag per page.
+extern uint8_t *WATCH_PAGES;
+
+/// Details of the last watchpoint hit, valid while WATCH_TRIGGERED is set.
+extern int WATCH_TRIGGERED;
+extern int WATCH_HIT_KIND;
+extern uint32_t WATCH_HIT_ADDR;
+
+int break_insert(uint32_t addr);
+int break_remove(uint32_t addr);
+
+static inline int break_at(uint32_t pc) {
+    const uint32_t *bits = BREAK_PAGES[pc >> DEBUG_PAGE_SHIFT];
+    return bits != NULL &&
+           ((bits[(pc >> 7) & ((1u << (DEBUG_PAGE_SHIFT - 7)) - 1)] >>
+             ((pc >> 2) & 31)) &
+            1);
+}
+
+/// Watch the word containing `addr` for reads and/or writes.
+int watch_insert(uint32_t addr, int kind);
+int watch_remove(uint32_t addr);
+
+void watch_check(uint32_t addr, uint32_t size, int kind);
+
+/// Hook for the load/store paths, a single predictable branch when no
+/// watchpoints are set.
+#define WATCH_ACCESS(addr, size, kind)           \
+    do {                                         \
+        if (NUM_WATCHPOINTS != 0) {              \
+            watch_check((addr), (size), (kind)); \
+        }                                        \
+    } while (0)
+
+void debug_list(FILE *out);
+
+#endif
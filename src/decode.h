@@ -0,0 +1,25 @@
+#ifndef _SIM_DECODE_H_
+#define _SIM_DECODE_H_
+
+#include <stdint.h>
+
+/* Instruction field decoders and immediate extensions, shared by the
+ * interpreter in sim.c and the ahead-of-time translator. */
+
+uint32_t extract_op(uint32_t inst);
+uint32_t extract_rs(uint32_t inst);
+uint32_t extract_rt(uint32_t inst);
+uint32_t extract_rd(uint32_t inst);
+uint32_t extract_target(uint32_t inst);
+uint32_t extract_imm(uint32_t inst);
+uint32_t extract_shamt(uint32_t inst);
+uint32_t extract_funct(uint32_t inst);
+
+uint32_t sign_ext(uint32_t imm);
+uint32_t sign_ext_byte(uint8_t imm);
+uint32_t sign_ext_half(uint16_t imm);
+uint32_t zero_ext(uint32_t imm);
+uint32_t zero_ext_byte(uint8_t imm);
+uint32_t zero_ext_half(uint16_t imm);
+
+#endif
@@ -0,0 +1,145 @@
+#include "isa.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include "asm.h"
+#include "decode.h"
+
+const isa_info_t ISA_INFO[ISA_NUM_IDS] = {
+#define INSN(name, format, kind, encoding, cycles, ...) \
+    { #name, ISA_FMT_##format, ISA_KIND_##kind, cycles, encoding },
+#include "isa.def"
+#undef INSN
+    /* mask 0 makes every word match, decoding to ISA_INVALID itself */
+    { "invalid", ISA_FMT_NONE, ISA_KIND_PLAIN, 1, 0, 0 },
+};
+
+uint8_t ISA_PRIMARY[64];
+uint8_t ISA_SPECIAL[64];
+uint8_t ISA_REGIMM[32];
+
+uint64_t ISA_COUNTS[ISA_NUM_IDS];
+uint64_t ISA_CYCLES;
+FILE *ISA_TRACE_FILE;
+
+void isa_init(void) {
+    int id;
+
+    memset(ISA_PRIMARY, ISA_INVALID, sizeof(ISA_PRIMARY));
+    memset(ISA_SPECIAL, ISA_INVALID, sizeof(ISA_SPECIAL));
+    memset(ISA_REGIMM, ISA_INVALID, sizeof(ISA_REGIMM));
+
+    for (id = 0; id < ISA_INVALID; id++) {
+        uint32_t match = ISA_INFO[id].match;
+
+        if (extract_op(match) == 0) {
+            ISA_SPECIAL[extract_funct(match)] = id;
+        } else if (extract_op(match) == 1) {
+            ISA_REGIMM[extract_rt(match)] = id;
+        } else {
+            ISA_PRIMARY[extract_op(match)] = id;
+        }
+    }
+}
+
+void isa_disasm(uint32_t inst, uint32_t pc, char *buf, size_t len) {
+    isa_id_t id = isa_decode(inst);
+    const char *rs = ASM_REG_NAMES[extract_rs(inst)];
+    const char *rt = ASM_REG_NAMES[extract_rt(inst)];
+    const char *rd = ASM_REG_NAMES[extract_rd(inst)];
+    uint32_t imm = extract_imm(inst);
+    uint32_t branch = pc + 4 + (sign_ext(imm) << 2);
+    char name[16];
+    size_t i;
+
+    if (id == ISA_INVALID) {
+        snprintf(buf, len, ".word 0x%08x", inst);
+        return;
+    }
+    for (i = 0; ISA_INFO[id].name[i] != '\0' && i + 1 < sizeof(name); i++) {
+        name[i] = tolower((unsigned char)ISA_INFO[id].name[i]);
+    }
+    name[i] = '\0';
+
+    switch (ISA_INFO[id].format) {
+        case ISA_FMT_NONE:
+            snprintf(buf, len, "%s", name);
+            break;
+        case ISA_FMT_R3:
+            snprintf(buf, len, "%-7s $%s, $%s, $%s", name, rd, rs, rt);
+            break;
+        case ISA_FMT_SHIFT:
+            snprintf(buf, len, "%-7s $%s, $%s, %u", name, rd, rt,
+                     extract_shamt(inst));
+            break;
+        case ISA_FMT_SHIFTV:
+            snprintf(buf, len, "%-7s $%s, $%s, $%s", name, rd, rt, rs);
+            break;
+        case ISA_FMT_JR:
+        case ISA_FMT_MT:
+            snprintf(buf, len, "%-7s $%s", name, rs);
+            break;
+        case ISA_FMT_JALR:
+            snprintf(buf, len, "%-7s $%s, $%s", name, rd, rs);
+            break;
+        case ISA_FMT_MF:
+            snprintf(buf, len, "%-7s $%s", name, rd);
+            break;
+        case ISA_FMT_MD:
+            snprintf(buf, len, "%-7s $%s, $%s", name, rs, rt);
+            break;
+        case ISA_FMT_IS:
+            snprintf(buf, len, "%-7s $%s, $%s, %d", name, rt, rs,
+                     (int32_t)sign_ext(imm));
+            break;
+        case ISA_FMT_IU:
+            snprintf(buf, len, "%-7s $%s, $%s, 0x%x", name, rt, rs, imm);
+            break;
+        case ISA_FMT_LUI:
+            snprintf(buf, len, "%-7s $%s, 0x%x", name, rt, imm);
+            break;
+        case ISA_FMT_B2:
+            snprintf(buf, len, "%-7s $%s, $%s, 0x%08x", name, rs, rt, branch);
+            break;
+        case ISA_FMT_B1:
+            snprintf(buf, len, "%-7s $%s, 0x%08x", name, rs, branch);
+            break;
+        case ISA_FMT_J:
+            snprintf(buf, len, "%-7s 0x%08x", name,
+                     (pc & 0xf0000000) | (extract_target(inst) << 2));
+            break;
+        case ISA_FMT_MEM:
+            snprintf(buf, len, "%-7s $%s, %d($%s)", name, rt,
+                     (int32_t)sign_ext(imm), rs);
+            break;
+    }
+}
+
+void isa_reset_counters(void) {
+    memset(ISA_COUNTS, 0, sizeof(ISA_COUNTS));
+    ISA_CYCLES = 0;
+}
+
+void isa_report(FILE *out) {
+    uint64_t total = 0;
+    int id;
+
+    for (id = 0; id < ISA_NUM_IDS; id++) {
+        total += ISA_COUNTS[id];
+    }
+    if (total != 0) {
+        fprintf(out, "Instruction mix of %llu instructions:\n",
+                (unsigned long long)total);
+        for (id = 0; id < ISA_NUM_IDS; id++) {
+            if (ISA_COUNTS[id] != 0) {
+                fprintf(out, "  %-8s %12llu  %5.1f%%\n", ISA_INFO[id].name,
+                        (unsigned long long)ISA_COUNTS[id],
+                        100.0 * ISA_COUNTS[id] / total);
+            }
+        }
+    }
+    if (ISA_CYCLES != 0) {
+        fprintf(out, "Cycles: %llu\n", (unsigned long long)ISA_CYCLES);
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef _SIM_ISA_H_
+#define _SIM_ISA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Instruction ids, in the order of isa.def.
+typedef enum {
+#define INSN(name, ...) ISA_##name,
+#include "isa.def"
+#undef INSN
+    ISA_INVALID,
+    ISA_NUM_IDS
+} isa_id_t;
+
+/// Control flow of an instruction, see isa.def.
+typedef enum {
+    ISA_KIND_PLAIN,
+    ISA_KIND_BRANCH,   /* conditional, pc-relative */
+    ISA_KIND_JUMP,     /* unconditional, static target */
+    ISA_KIND_INDIRECT, /* target in a register */
+    ISA_KIND_SYSCALL,
+} isa_kind_t;
+
+/// Operand layouts, named after the assembler syntax they print as.
+typedef enum {
+    ISA_FMT_NONE,   /* syscall */
+    ISA_FMT_R3,     /* rd, rs, rt */
+    ISA_FMT_SHIFT,  /* rd, rt, shamt */
+    ISA_FMT_SHIFTV, /* rd, rt, rs */
+    ISA_FMT_JR,     /* rs */
+    ISA_FMT_JALR,   /* rd, rs */
+    ISA_FMT_MF,     /* rd */
+    ISA_FMT_MT,     /* rs */
+    ISA_FMT_MD,     /* rs, rt */
+    ISA_FMT_IS,     /* rt, rs, signed imm */
+    ISA_FMT_IU,     /* rt, rs, unsigned imm */
+    ISA_FMT_LUI,    /* rt, imm */
+    ISA_FMT_B2,     /* rs, rt, target */
+    ISA_FMT_B1,     /* rs, target */
+    ISA_FMT_J,      /* target */
+    ISA_FMT_MEM,    /* rt, offset(rs) */
+} isa_format_t;
+
+typedef struct {
+    const char *name;
+    uint8_t format, kind, cycles;
+    uint32_t mask, match;
+} isa_info_t;
+
+extern const isa_info_t ISA_INFO[ISA_NUM_IDS];
+
+/// Decode tables indexed by opcode, by funct when the opcode is SPECIAL and
+/// by rt when it is REGIMM. Filled in by isa_init().
+extern uint8_t ISA_PRIMARY[64];
+extern uint8_t ISA_SPECIAL[64];
+extern uint8_t ISA_REGIMM[32];
+
+/// Build the decode tables from isa.def.
+void isa_init(void);
+
+/// Id of an encoded instruction, ISA_INVALID when the table has none.
+static inline isa_id_t isa_decode(uint32_t inst) {
+    uint32_t op = inst >> 26;
+    isa_id_t id;
+
+    if (op == 0) {
+        id = ISA_SPECIAL[inst & 0x3f];
+    } else if (op == 1) {
+        id = ISA_REGIMM[(inst >> 16) & 0x1f];
+    } else {
+        id = ISA_PRIMARY[op];
+    }
+    if ((inst & ISA_INFO[id].mask) != ISA_INFO[id].match) {
+        return ISA_INVALID;
+    }
+    return id;
+}
+
+/// Disassemble the instruction at `pc` into `buf`.
+void isa_disasm(uint32_t inst, uint32_t pc, char *buf, size_t len);
+
+/// Instrumentation of the generated interpreter variants: executions per
+/// id for the stats-counting one, the cycle total for the timing one, and
+/// where the traced one writes to (stdout when NULL).
+extern uint64_t ISA_COUNTS[ISA_NUM_IDS];
+extern uint64_t ISA_CYCLES;
+extern FILE *ISA_TRACE_FILE;
+
+void isa_reset_counters(void);
+
+/// Print the instruction mix and cycle total gathered so far.
+void isa_report(FILE *out);
+
+#endif
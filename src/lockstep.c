@@ -0,0 +1,738 @@
+#include "lockstep.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "decode.h"
+#include "isa.h"
+#include "memmap.h"
+#include "shell.h"
+#include "syscall.h"
+
+/*
+ * Register files are kept as structure of arrays: one vector per register
+ * with an element per lane. GCC vector extensions lower the lane operations
+ * to whatever SIMD the target has, SSE2 by default and AVX2 with
+ * `-mavx2`/`-march=native`.
+ *
+ * Each step runs the instruction at a single PC for every lane waiting
+ * there (the mask). When lanes diverge on a branch, the group with the
+ * lowest PC runs first, so lanes which skipped ahead wait for the others to
+ * catch up and rejoin them at the common PC.
+ *
+ * While every live lane is at the same PC (converged), the per-lane PCs and
+ * instruction counts are left alone and only `cur` and `span` move; they
+ * are written back when the lanes split up or stop.
+ */
+
+typedef uint32_t lane_t __attribute__((vector_size(4 * LOCKSTEP_MAX_LANES)));
+typedef int32_t lane_signed_t
+    __attribute__((vector_size(4 * LOCKSTEP_MAX_LANES)));
+
+#define LOCKSTEP_MAX_REGIONS 8
+
+#define SPLAT(x) ((lane_t){0} + (uint32_t)(x))
+
+/* keep the old value in lanes outside the mask */
+#define BLEND(old, new) (((new) & ls->mask) | ((old) & ~ls->mask))
+#define SET(r, v) (ls->regs[(r)] = BLEND(ls->regs[(r)], (v)))
+
+/* per-lane counters are folded into 64 bits before they can wrap */
+#define FOLD_INTERVAL (1u << 30)
+
+typedef enum {
+    LANE_RUNNING,
+    LANE_HALTED,
+    LANE_UNKNOWN, /* the interpreter would spin on this instruction */
+    LANE_DIVIDE,  /* division by zero or overflow */
+    LANE_MEMORY,  /* an access the memory map does not permit */
+    LANE_SYSCALL, /* a system call other than exit, host I/O is not run */
+} lane_status_t;
+
+typedef struct {
+    uint32_t start, size;
+    int perms;
+    uint8_t *mem;
+} lane_region_t;
+
+/// An instruction with its fields pulled out, decoded once per text word.
+typedef struct {
+    uint32_t inst;
+    uint32_t imm, simm; /* zero and sign extended */
+    uint8_t id, rs, rt, rd, shamt; /* id is an isa_id_t */
+} lane_insn_t;
+
+typedef struct {
+    lane_t regs[MIPS_REGS];
+    lane_t hi, lo, pc;
+    lane_t live; /* all ones for lanes still running */
+    lane_t mask; /* lanes executing the current step */
+    lane_t counts;
+
+    int converged;
+    uint64_t span; /* steps since the lanes converged */
+
+    int lanes;
+    lane_status_t status[LOCKSTEP_MAX_LANES];
+    uint32_t fault_inst[LOCKSTEP_MAX_LANES];
+    uint64_t executed[LOCKSTEP_MAX_LANES];
+
+    /* the shared text region */
+    uint32_t text_base, text_words;
+    lane_insn_t *text;
+
+    int num_regions;
+    lane_region_t regions[LOCKSTEP_MAX_LANES][LOCKSTEP_MAX_REGIONS];
+} lockstep_t;
+
+/* Vectors are passed by address, by value their ABI depends on -m flags. */
+
+static int none(const lane_t *v) {
+    static const lane_t zero;
+    return memcmp(v, &zero, sizeof(lane_t)) == 0;
+}
+
+static int first_lane(const lane_t *mask) {
+    int i;
+    for (i = 0; i < LOCKSTEP_MAX_LANES; i++) {
+        if ((*mask)[i] != 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void decode(lane_insn_t *d, uint32_t inst) {
+    d->inst = inst;
+    d->imm = extract_imm(inst);
+    d->simm = sign_ext(d->imm);
+    d->id = isa_decode(inst);
+    d->rs = extract_rs(inst);
+    d->rt = extract_rt(inst);
+    d->rd = extract_rd(inst);
+    d->shamt = extract_shamt(inst);
+}
+
+/// Write the PC and instruction count of converged lanes back to the
+/// vectors, before the lanes split up or some of them stop.
+static void diverge(lockstep_t *ls, uint32_t cur) {
+    if (!ls->converged) {
+        return;
+    }
+    ls->pc = BLEND(ls->pc, SPLAT(cur));
+    ls->counts += SPLAT(ls->span) & ls->live;
+    ls->span = 0;
+    ls->converged = FALSE;
+}
+
+static void fold_counts(lockstep_t *ls) {
+    int i;
+    for (i = 0; i < ls->lanes; i++) {
+        ls->executed[i] += ls->counts[i];
+    }
+    ls->counts = SPLAT(0);
+}
+
+/// Private copy of a region. Only the pages the host has backed can hold
+/// anything but zeros, so the others are neither scanned nor copied and are
+/// left to the kernel's zero page; large mostly empty regions cost nothing.
+static uint8_t *copy_region(const uint8_t *mem, uint32_t size) {
+    static const uint8_t zero[4096];
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned char *resident;
+    uint8_t *copy;
+    uint32_t offset, end, n;
+    size_t pages;
+
+    if (size == 0) {
+        return NULL;
+    }
+    copy = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (copy == MAP_FAILED) {
+        fprintf(stderr, "Error: out of memory for lane copies\n");
+        exit(1);
+    }
+    pages = (size + page - 1) / page;
+    resident = malloc(pages);
+    if (mincore((void *)mem, size, resident) != 0) {
+        memset(resident, 1, pages);
+    }
+    for (offset = 0; offset < size; offset = end) {
+        end = size - offset < page ? size : offset + page;
+        if (!(resident[offset / page] & 1)) {
+            continue;
+        }
+        for (; offset < end; offset += n) {
+            n = end - offset < sizeof(zero) ? end - offset : sizeof(zero);
+            if (memcmp(mem + offset, zero, n) != 0) {
+                memcpy(copy + offset, mem + offset, n);
+            }
+        }
+    }
+    free(resident);
+    return copy;
+}
+
+/// Lanes in `which` stop with `status` at `cur`.
+static void retire(lockstep_t *ls, const lane_t *which, lane_status_t status,
+                   uint32_t inst, uint32_t cur) {
+    int i;
+
+    diverge(ls, cur);
+    for (i = 0; i < ls->lanes; i++) {
+        if ((*which)[i] != 0) {
+            ls->status[i] = status;
+            ls->fault_inst[i] = inst;
+        }
+    }
+    ls->live &= ~*which;
+}
+
+/// Host pointer to `size` bytes at `addr` as seen by `lane`, NULL if they
+/// are not all mapped. `*perms` gets the permissions of the region holding
+/// `addr`, all of them where there is none.
+static uint8_t *lane_ptr(lockstep_t *ls, int lane, uint32_t addr,
+                         uint32_t size, int *perms) {
+    lane_region_t *region = ls->regions[lane];
+    mem_region_t *shared;
+    uint32_t avail;
+    uint8_t *mem;
+    int i;
+
+    for (i = 0; i < ls->num_regions; i++) {
+        uint32_t offset = addr - region[i].start;
+        if (offset < region[i].size) {
+            *perms = region[i].perms;
+            return region[i].size - offset >= size ? region[i].mem + offset
+                                                   : NULL;
+        }
+    }
+    shared = memmap_lookup(addr);
+    *perms = shared != NULL ? shared->perms : MEM_READ | MEM_WRITE;
+    mem = mem_ptr(addr, &avail);
+    return avail >= size ? mem : NULL;
+}
+
+/// Little endian load of `size` bytes for every lane in the mask, unmapped
+/// addresses read as 0 like mem_read_32(). Lanes reading a region without
+/// read permission stop, like load() in sim.c. The lanes' addresses are
+/// scattered, so this is a loop over the lanes rather than vector code.
+static void load(lockstep_t *ls, const lane_t *addr, uint32_t size,
+                 lane_t *value, uint32_t inst, uint32_t cur) {
+    lane_t bad = {0};
+    int i, perms;
+
+    *value = SPLAT(0);
+    for (i = 0; i < ls->lanes; i++) {
+        uint8_t *mem;
+        if (ls->mask[i] == 0) {
+            continue;
+        }
+        mem = lane_ptr(ls, i, (*addr)[i], size, &perms);
+        if (!(perms & MEM_READ)) {
+            bad[i] = 0xffffffff;
+            continue;
+        }
+        if (mem == NULL) {
+            continue;
+        }
+        switch (size) {
+            case 1:
+                (*value)[i] = mem[0];
+                break;
+            case 2:
+                (*value)[i] = mem[0] | (mem[1] << 8);
+                break;
+            default:
+                (*value)[i] = mem[0] | (mem[1] << 8) | (mem[2] << 16) |
+                              ((uint32_t)mem[3] << 24);
+                break;
+        }
+    }
+    if (!none(&bad)) {
+        retire(ls, &bad, LANE_MEMORY, inst, cur);
+    }
+}
+
+static void store(lockstep_t *ls, const lane_t *addr, const lane_t *value,
+                  uint32_t size, uint32_t inst, uint32_t cur) {
+    lane_t bad = {0};
+    uint32_t b, word;
+    int i, perms;
+
+    for (i = 0; i < ls->lanes; i++) {
+        uint8_t *mem;
+        if (ls->mask[i] == 0) {
+            continue;
+        }
+        mem = lane_ptr(ls, i, (*addr)[i], size, &perms);
+        if (!(perms & MEM_WRITE)) {
+            bad[i] = 0xffffffff;
+            continue;
+        }
+        if (mem == NULL) {
+            continue;
+        }
+        for (b = 0; b < size; b++) {
+            mem[b] = (*value)[i] >> (8 * b);
+        }
+
+        /* code is shared, so a lane writing it changes it for all */
+        word = ((*addr)[i] - ls->text_base) >> 2;
+        if ((*addr)[i] >= ls->text_base && word < ls->text_words) {
+            decode(&ls->text[word], mem_read_32(ls->text_base + word * 4));
+            if (word + 1 < ls->text_words) {
+                decode(&ls->text[word + 1],
+                       mem_read_32(ls->text_base + word * 4 + 4));
+            }
+        }
+    }
+    if (!none(&bad)) {
+        retire(ls, &bad, LANE_MEMORY, inst, cur);
+    }
+}
+
+/// Move the lanes in the mask to `next`. Returns TRUE if the lanes need to
+/// be scheduled again, i.e. unless every live lane was in the mask and they
+/// all went to the same place, which then becomes `*cur`.
+static int jump(lockstep_t *ls, const lane_t *next, uint32_t *cur) {
+    lane_t rest, diverged;
+    int first;
+
+    rest = ls->live & ~ls->mask;
+    first = first_lane(&ls->mask);
+    diverged = (*next ^ SPLAT((*next)[first])) & ls->mask;
+    if (!none(&rest) || !none(&diverged)) {
+        diverge(ls, *cur);
+        ls->pc = BLEND(ls->pc, *next);
+        return TRUE;
+    }
+
+    /* everyone is here, whether or not they were before */
+    ls->converged = TRUE;
+    *cur = (*next)[first];
+    return FALSE;
+}
+
+/// Branch to `cur + 4 + offset` in the lanes where `taken` is all ones.
+static int branch(lockstep_t *ls, const lane_t *taken, uint32_t simm,
+                  uint32_t *cur) {
+    uint32_t target = *cur + 4 + (simm << 2);
+    lane_t next = (SPLAT(target) & *taken) | (SPLAT(*cur + 4) & ~*taken);
+    return jump(ls, &next, cur);
+}
+
+/// DIV and DIVU one lane at a time, lanes which would trap the host stop.
+static void divide(lockstep_t *ls, uint32_t rs, uint32_t rt, int is_signed,
+                   uint32_t inst, uint32_t cur) {
+    lane_t bad = {0};
+    int i;
+
+    for (i = 0; i < ls->lanes; i++) {
+        uint32_t lhs = ls->regs[rs][i], rhs = ls->regs[rt][i];
+        if (ls->mask[i] == 0) {
+            continue;
+        }
+        if (rhs == 0 || (is_signed && lhs == 0x80000000 && rhs == 0xffffffff)) {
+            bad[i] = 0xffffffff;
+        } else if (is_signed) {
+            ls->lo[i] = (int32_t)lhs / (int32_t)rhs;
+            ls->hi[i] = (int32_t)lhs % (int32_t)rhs;
+        } else {
+            ls->lo[i] = lhs / rhs;
+            ls->hi[i] = lhs % rhs;
+        }
+    }
+    if (!none(&bad)) {
+        retire(ls, &bad, LANE_DIVIDE, inst, cur);
+    }
+}
+
+/// Execute `d` at `*cur` for the lanes in the mask, following
+/// process_instruction(). Returns TRUE when the lanes must be scheduled
+/// again, otherwise `*cur` is the PC of the next step.
+static int execute(lockstep_t *ls, const lane_insn_t *d, uint32_t *cur) {
+    uint32_t rs = d->rs, rt = d->rt, rd = d->rd;
+    lane_t *regs = ls->regs;
+    lane_t addr, value;
+
+    /* no default, so the compiler names any isa.def entry missing here */
+    switch ((isa_id_t)d->id) {
+        case ISA_SLL:
+            SET(rd, regs[rt] << d->shamt);
+            break;
+        case ISA_SRL:
+            SET(rd, regs[rt] >> d->shamt);
+            break;
+        case ISA_SRA:
+            SET(rd, (lane_t)((lane_signed_t)regs[rt] >> d->shamt));
+            break;
+        case ISA_SLLV:
+            SET(rd, regs[rt] << (regs[rs] & 0x1f));
+            break;
+        case ISA_SRLV:
+            SET(rd, regs[rt] >> (regs[rs] & 0x1f));
+            break;
+        case ISA_SRAV:
+            SET(rd, (lane_t)((lane_signed_t)regs[rt] >>
+                             (lane_signed_t)(regs[rs] & 0x1f)));
+            break;
+        case ISA_JR:
+            value = regs[rs];
+            return jump(ls, &value, cur);
+        case ISA_JALR:
+            value = regs[rs];
+            SET(rd, SPLAT(*cur + 4));
+            return jump(ls, &value, cur);
+        case ISA_SYSCALL: {
+            lane_t halting = ls->mask & (lane_t)((regs[2] == SYS_EXIT) |
+                                                 (regs[2] == SYS_EXIT2));
+            lane_t other = ls->mask & ~halting;
+            if (!none(&halting)) {
+                retire(ls, &halting, LANE_HALTED, d->inst, *cur);
+            }
+            if (!none(&other)) {
+                retire(ls, &other, LANE_SYSCALL, d->inst, *cur);
+            }
+            return TRUE;
+        }
+        case ISA_MFHI:
+            SET(rd, ls->hi);
+            break;
+        case ISA_MTHI:
+            ls->hi = BLEND(ls->hi, regs[rs]);
+            break;
+        case ISA_MFLO:
+            SET(rd, ls->lo);
+            break;
+        case ISA_MTLO:
+            ls->lo = BLEND(ls->lo, regs[rs]);
+            break;
+        case ISA_MULT:
+            /* only the low word, like the interpreter */
+            ls->hi = BLEND(ls->hi, SPLAT(0));
+            ls->lo = BLEND(ls->lo, regs[rs] * regs[rt]);
+            break;
+        case ISA_MULTU: {
+            int i;
+            for (i = 0; i < ls->lanes; i++) {
+                if (ls->mask[i] != 0) {
+                    uint64_t product = (uint64_t)regs[rs][i] * regs[rt][i];
+                    ls->hi[i] = product >> 32;
+                    ls->lo[i] = (uint32_t)product;
+                }
+            }
+            break;
+        }
+        case ISA_DIV:
+            divide(ls, rs, rt, TRUE, d->inst, *cur);
+            break;
+        case ISA_DIVU:
+            divide(ls, rs, rt, FALSE, d->inst, *cur);
+            break;
+        case ISA_ADD:
+        case ISA_ADDU:
+            SET(rd, regs[rs] + regs[rt]);
+            break;
+        case ISA_SUB:
+        case ISA_SUBU:
+            SET(rd, regs[rs] - regs[rt]);
+            break;
+        case ISA_AND:
+            SET(rd, regs[rs] & regs[rt]);
+            break;
+        case ISA_OR:
+            SET(rd, regs[rs] | regs[rt]);
+            break;
+        case ISA_XOR:
+            SET(rd, regs[rs] ^ regs[rt]);
+            break;
+        case ISA_NOR:
+            SET(rd, ~(regs[rs] | regs[rt]));
+            break;
+        case ISA_SLT:
+            SET(rd, (lane_t)((lane_signed_t)regs[rs] <
+                             (lane_signed_t)regs[rt]) & 1);
+            break;
+        case ISA_SLTU:
+            SET(rd, (lane_t)(regs[rs] < regs[rt]) & 1);
+            break;
+        case ISA_BLTZ:
+            value = (lane_t)((lane_signed_t)regs[rs] < 0);
+            return branch(ls, &value, d->simm, cur);
+        case ISA_BGEZ:
+            value = (lane_t)((lane_signed_t)regs[rs] >= 0);
+            return branch(ls, &value, d->simm, cur);
+        case ISA_BLTZAL:
+            value = (lane_t)((lane_signed_t)regs[rs] < 0);
+            SET(31, SPLAT(*cur + 4));
+            return branch(ls, &value, d->simm, cur);
+        case ISA_BGEZAL:
+            value = (lane_t)((lane_signed_t)regs[rs] >= 0);
+            SET(31, SPLAT(*cur + 4));
+            return branch(ls, &value, d->simm, cur);
+        case ISA_J:
+        case ISA_JAL:
+            if (d->id == ISA_JAL) {
+                SET(31, SPLAT(*cur + 4));
+            }
+            value = SPLAT((*cur & 0xf0000000) |
+                          (extract_target(d->inst) << 2));
+            return jump(ls, &value, cur);
+        case ISA_BEQ:
+            value = (lane_t)(regs[rs] == regs[rt]);
+            return branch(ls, &value, d->simm, cur);
+        case ISA_BNE:
+            value = (lane_t)(regs[rs] != regs[rt]);
+            return branch(ls, &value, d->simm, cur);
+        case ISA_BLEZ:
+            value = (lane_t)((lane_signed_t)regs[rs] <= 0);
+            return branch(ls, &value, d->simm, cur);
+        case ISA_BGTZ:
+            value = (lane_t)((lane_signed_t)regs[rs] > 0);
+            return branch(ls, &value, d->simm, cur);
+        case ISA_ADDI:
+        case ISA_ADDIU:
+            SET(rt, regs[rs] + d->simm);
+            break;
+        case ISA_SLTI:
+            SET(rt, (lane_t)((lane_signed_t)regs[rs] <
+                             (lane_signed_t)SPLAT(d->simm)) & 1);
+            break;
+        case ISA_SLTIU:
+            SET(rt, (lane_t)(regs[rs] < d->simm) & 1);
+            break;
+        case ISA_ANDI:
+            SET(rt, regs[rs] & d->imm);
+            break;
+        case ISA_ORI:
+            SET(rt, regs[rs] | d->imm);
+            break;
+        case ISA_XORI:
+            SET(rt, regs[rs] ^ d->imm);
+            break;
+        case ISA_LUI:
+            SET(rt, SPLAT(d->imm << 16));
+            break;
+        case ISA_LB:
+            addr = regs[rs] + d->simm;
+            load(ls, &addr, 1, &value, d->inst, *cur);
+            SET(rt, (lane_t)((lane_signed_t)(value << 24) >> 24));
+            break;
+        case ISA_LH:
+            addr = regs[rs] + d->simm;
+            load(ls, &addr, 2, &value, d->inst, *cur);
+            SET(rt, (lane_t)((lane_signed_t)(value << 16) >> 16));
+            break;
+        case ISA_LW:
+            addr = regs[rs] + d->simm;
+            load(ls, &addr, 4, &value, d->inst, *cur);
+            SET(rt, value);
+            break;
+        case ISA_LBU:
+            addr = regs[rs] + d->simm;
+            load(ls, &addr, 1, &value, d->inst, *cur);
+            SET(rt, value);
+            break;
+        case ISA_LHU:
+            addr = regs[rs] + d->simm;
+            load(ls, &addr, 2, &value, d->inst, *cur);
+            SET(rt, value);
+            break;
+        case ISA_SB:
+            addr = regs[rs] + d->simm;
+            store(ls, &addr, &regs[rt], 1, d->inst, *cur);
+            break;
+        case ISA_SH:
+            addr = regs[rs] + d->simm;
+            store(ls, &addr, &regs[rt], 2, d->inst, *cur);
+            break;
+        case ISA_SW:
+            addr = regs[rs] + d->simm;
+            store(ls, &addr, &regs[rt], 4, d->inst, *cur);
+            break;
+        case ISA_INVALID:
+        case ISA_NUM_IDS:
+            retire(ls, &ls->mask, LANE_UNKNOWN, d->inst, *cur);
+            return TRUE;
+    }
+
+    if (!ls->converged) {
+        /* lanes stopped by a division or memory fault keep their PC */
+        ls->mask &= ls->live;
+        if (none(&ls->mask)) {
+            return TRUE;
+        }
+        ls->pc = BLEND(ls->pc, SPLAT(*cur + 4));
+    }
+    *cur += 4;
+    return FALSE;
+}
+
+/// Lowest PC of the live lanes.
+static uint32_t min_pc(lockstep_t *ls) {
+    uint32_t pc = 0xffffffff;
+    int i;
+    for (i = 0; i < ls->lanes; i++) {
+        if (ls->live[i] != 0 && ls->pc[i] < pc) {
+            pc = ls->pc[i];
+        }
+    }
+    return pc;
+}
+
+static uint64_t run(lockstep_t *ls, uint64_t max_steps) {
+    uint64_t steps = 0;
+    uint32_t fold = 0, cur = 0;
+    int schedule = TRUE;
+    lane_insn_t fetched;
+    const lane_insn_t *d;
+
+    while (max_steps == 0 || steps < max_steps) {
+        if (schedule) {
+            if (none(&ls->live)) {
+                break;
+            }
+            cur = min_pc(ls);
+            ls->mask = ls->live & (lane_t)(ls->pc == cur);
+            ls->converged = memcmp(&ls->mask, &ls->live, sizeof(lane_t)) == 0;
+        } else if (!ls->converged) {
+            /* picks up lanes which were waiting at cur */
+            ls->mask = ls->live & (lane_t)(ls->pc == cur);
+        }
+
+        if (ls->converged) {
+            ls->span++;
+        } else {
+            ls->counts -= ls->mask;
+            if (++fold == FOLD_INTERVAL) {
+                fold_counts(ls);
+                fold = 0;
+            }
+        }
+
+        if (cur - ls->text_base < ls->text_words * 4 && (cur & 3) == 0) {
+            d = &ls->text[(cur - ls->text_base) >> 2];
+        } else {
+            decode(&fetched, mem_read_32(cur));
+            d = &fetched;
+        }
+        schedule = execute(ls, d, &cur);
+        steps++;
+    }
+    diverge(ls, cur);
+    fold_counts(ls);
+    return steps;
+}
+
+void lockstep_run(int lanes, uint64_t max_steps, FILE *out, FILE *dump) {
+    lockstep_t *ls = calloc(1, sizeof(lockstep_t));
+    struct timespec start, end;
+    uint32_t base, size, i;
+    uint64_t steps, total = 0;
+    double elapsed;
+    uint8_t *mem;
+    int lane, r;
+
+    ls->lanes = lanes;
+    for (i = 0; i < MIPS_REGS; i++) {
+        ls->regs[i] = SPLAT(CURRENT_STATE.REGS[i]);
+    }
+    ls->hi = SPLAT(CURRENT_STATE.HI);
+    ls->lo = SPLAT(CURRENT_STATE.LO);
+    ls->pc = SPLAT(CURRENT_STATE.PC);
+    for (lane = 0; lane < lanes; lane++) {
+        ls->regs[4][lane] = lane;
+        ls->live[lane] = 0xffffffff;
+    }
+
+    /* every lane gets its own copy of everything but the text */
+    for (r = 0; (mem = mem_region(r, &base, &size)) != NULL; r++) {
+        if (CURRENT_STATE.PC - base < size) {
+            ls->text_base = base;
+            ls->text_words = size / 4;
+            ls->text = malloc(ls->text_words * sizeof(lane_insn_t));
+            for (i = 0; i < ls->text_words; i++) {
+                decode(&ls->text[i], mem_read_32(base + i * 4));
+            }
+            continue;
+        }
+        if (ls->num_regions == LOCKSTEP_MAX_REGIONS) {
+            continue;
+        }
+        for (lane = 0; lane < lanes; lane++) {
+            lane_region_t *region = &ls->regions[lane][ls->num_regions];
+            region->start = base;
+            region->size = size;
+            region->perms = MEM_REGIONS[r].perms;
+            region->mem = copy_region(mem, size);
+        }
+        ls->num_regions++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    steps = run(ls, max_steps);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (lane = 0; lane < lanes; lane++) {
+        fprintf(out, "lane %2d: %10llu instructions, PC 0x%08x, $v0 0x%08x, ",
+                lane, (unsigned long long)ls->executed[lane], ls->pc[lane],
+                ls->regs[2][lane]);
+        switch (ls->status[lane]) {
+            case LANE_RUNNING:
+                fprintf(out, "stopped\n");
+                break;
+            case LANE_HALTED:
+                fprintf(out, "halted\n");
+                break;
+            case LANE_UNKNOWN:
+                fprintf(out, "unknown instruction 0x%08x\n",
+                        ls->fault_inst[lane]);
+                break;
+            case LANE_DIVIDE:
+                fprintf(out, "division fault\n");
+                break;
+            case LANE_MEMORY:
+                fprintf(out, "memory fault\n");
+                break;
+            case LANE_SYSCALL:
+                fprintf(out, "syscall %u\n", ls->regs[2][lane]);
+                break;
+        }
+        total += ls->executed[lane];
+
+        if (dump != NULL) {
+            fprintf(dump, "Lane %d\n", lane);
+            fprintf(dump, "Instruction Count : %llu\n",
+                    (unsigned long long)ls->executed[lane]);
+            fprintf(dump, "PC                : 0x%08x\n", ls->pc[lane]);
+            for (i = 0; i < MIPS_REGS; i++) {
+                fprintf(dump, "R%d: 0x%08x\n", i, ls->regs[i][lane]);
+            }
+            fprintf(dump, "HI: 0x%08x\n", ls->hi[lane]);
+            fprintf(dump, "LO: 0x%08x\n\n", ls->lo[lane]);
+        }
+    }
+    fprintf(out, "%d lanes, %llu instructions in %llu steps, %.3f s",
+            lanes, (unsigned long long)total, (unsigned long long)steps,
+            elapsed);
+    if (elapsed > 0) {
+        fprintf(out, ", %.2f MIPS", total / elapsed / 1e6);
+    }
+    fprintf(out, "\n");
+
+    for (r = 0; r < ls->num_regions; r++) {
+        for (lane = 0; lane < lanes; lane++) {
+            if (ls->regions[lane][r].mem != NULL) {
+                munmap(ls->regions[lane][r].mem, ls->regions[lane][r].size);
+            }
+        }
+    }
+    free(ls->text);
+    free(ls);
+}
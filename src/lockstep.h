@@ -0,0 +1,21 @@
+#ifndef _SIM_LOCKSTEP_H_
+#define _SIM_LOCKSTEP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/// Width of the lane vectors. Runs may use fewer lanes, the rest stay idle.
+#define LOCKSTEP_MAX_LANES 16
+
+/// Run `lanes` copies of the loaded program side by side, starting from
+/// CURRENT_STATE with $a0 set to the lane number. Every memory region except
+/// the one holding the text is private to each lane. Lanes run until they
+/// halt, hit an instruction the interpreter would not advance past, divide
+/// by zero, access memory against the region permissions, make a system
+/// call other than exit (host I/O is not run in lockstep), or
+/// `max_steps` steps have been issued (0 for no limit). Prints a line per
+/// lane and the aggregate rate to `out`, and the registers of every lane to
+/// `dump` unless it is NULL.
+void lockstep_run(int lanes, uint64_t max_steps, FILE *out, FILE *dump);
+
+#endif
@@ -0,0 +1,231 @@
+#include "memmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+mem_region_t MEM_REGIONS[MEMMAP_MAX_REGIONS] = {
+    { "text", 0x00400000, 0x00100000, 0, MEM_READ | MEM_WRITE, NULL },
+    { "data", 0x10000000, 0x00100000, 0, MEM_READ | MEM_WRITE, NULL },
+    { "stack", 0x7ff00000, 0x00100000, 0, MEM_READ | MEM_WRITE, NULL },
+    { "kdata", 0x90000000, 0x00100000, 0, MEM_READ | MEM_WRITE, NULL },
+    { "ktext", 0x80000000, 0x00100000, 0, MEM_READ | MEM_WRITE, NULL },
+    /* start and limit are filled in by memmap_map() when left at 0 */
+    { "heap", 0, 0, 0, MEM_READ | MEM_WRITE, NULL },
+};
+
+int MEM_NREGIONS = 6;
+
+mem_region_t *MEM_LAST = &MEM_REGIONS[0];
+
+mem_region_t *memmap_find(const char *name) {
+    int i;
+
+    for (i = 0; i < MEM_NREGIONS; i++) {
+        if (strcmp(MEM_REGIONS[i].name, name) == 0) {
+            return &MEM_REGIONS[i];
+        }
+    }
+    return NULL;
+}
+
+/// Parse a number with an optional K, M or G suffix.
+static int parse_size(const char *text, uint64_t *value) {
+    char *end;
+
+    *value = strtoull(text, &end, 0);
+    if (end == text) {
+        return -1;
+    }
+    switch (*end) {
+        case 'k': case 'K':
+            *value <<= 10;
+            end++;
+            break;
+        case 'm': case 'M':
+            *value <<= 20;
+            end++;
+            break;
+        case 'g': case 'G':
+            *value <<= 30;
+            end++;
+            break;
+    }
+    return *end == '\0' && *value <= 0x100000000ull ? 0 : -1;
+}
+
+int memmap_set(const char *spec, char *error, size_t len) {
+    char buf[128], *name, *fields[3] = { NULL, NULL, NULL }, *p;
+    uint64_t start, size;
+    mem_region_t *region;
+    int perms = MEM_READ | MEM_WRITE, n;
+
+    if (strlen(spec) >= sizeof(buf)) {
+        snprintf(error, len, "memory spec too long: %s", spec);
+        return -1;
+    }
+    strcpy(buf, spec);
+    name = buf;
+    if ((p = strchr(buf, '=')) == NULL) {
+        snprintf(error, len, "expected name=start:size[:perms]: %s", spec);
+        return -1;
+    }
+    *p++ = '\0';
+    for (n = 0; n < 3 && p != NULL; n++) {
+        fields[n] = p;
+        if ((p = strchr(p, ':')) != NULL) {
+            *p++ = '\0';
+        }
+    }
+    if (n < 2 || p != NULL || name[0] == '\0' ||
+        strlen(name) >= sizeof(region->name)) {
+        snprintf(error, len, "expected name=start:size[:perms]: %s", spec);
+        return -1;
+    }
+    if (parse_size(fields[0], &start) != 0 || start > 0xffffffffull ||
+        parse_size(fields[1], &size) != 0 || start + size > 0x100000000ull) {
+        snprintf(error, len, "bad address range: %s", spec);
+        return -1;
+    }
+    if (fields[2] != NULL) {
+        perms = 0;
+        for (p = fields[2]; *p != '\0'; p++) {
+            if (*p == 'r') {
+                perms |= MEM_READ;
+            } else if (*p == 'w') {
+                perms |= MEM_WRITE;
+            } else if (*p != '-') {
+                snprintf(error, len, "permissions are r and w: %s", spec);
+                return -1;
+            }
+        }
+    }
+
+    if ((region = memmap_find(name)) == NULL) {
+        if (MEM_NREGIONS == MEMMAP_MAX_REGIONS) {
+            snprintf(error, len, "more than %d regions", MEMMAP_MAX_REGIONS);
+            return -1;
+        }
+        region = &MEM_REGIONS[MEM_NREGIONS++];
+        strcpy(region->name, name);
+    }
+    region->start = start;
+    region->perms = perms;
+    if (strcmp(name, "heap") == 0) {
+        /* the heap starts empty, `size` is how far it may grow */
+        region->size = 0;
+        region->limit = size;
+    } else {
+        region->size = size;
+    }
+    return 0;
+}
+
+int memmap_load(const char *filename, char *error, size_t len) {
+    char line[256], *spec, *end;
+    FILE *in;
+    int lineno = 0;
+
+    if ((in = fopen(filename, "r")) == NULL) {
+        snprintf(error, len, "can't open %s", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        lineno++;
+        if ((end = strchr(line, '#')) != NULL) {
+            *end = '\0';
+        }
+        spec = line + strspn(line, " \t");
+        end = spec + strcspn(spec, " \t\r\n");
+        if (end == spec) {
+            continue;
+        }
+        *end = '\0';
+        if (memmap_set(spec, error, len) != 0) {
+            size_t used = strlen(error);
+            snprintf(error + used, len - used, " (%s:%d)", filename, lineno);
+            fclose(in);
+            return -1;
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+static uint64_t extent(const mem_region_t *region) {
+    return region->limit > region->size ? region->limit : region->size;
+}
+
+int memmap_map(char *error, size_t len) {
+    mem_region_t *heap = memmap_find("heap"), *data = memmap_find("data");
+    uint64_t bytes;
+    int i, j;
+
+    if (heap != NULL && heap->start == 0 && data != NULL) {
+        heap->start = data->start + data->size;
+    }
+    if (heap != NULL && heap->limit == 0) {
+        /* up to whatever comes next */
+        bytes = 0x100000000ull - heap->start;
+        for (i = 0; i < MEM_NREGIONS; i++) {
+            if (&MEM_REGIONS[i] != heap && MEM_REGIONS[i].start >= heap->start &&
+                MEM_REGIONS[i].start - heap->start < bytes) {
+                bytes = MEM_REGIONS[i].start - heap->start;
+            }
+        }
+        heap->limit = bytes > 0xffffffffull ? 0xfffff000u : bytes;
+    }
+
+    for (i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *a = &MEM_REGIONS[i];
+
+        if (a->limit < a->size) {
+            a->limit = a->size;
+        }
+        for (j = 0; j < i; j++) {
+            mem_region_t *b = &MEM_REGIONS[j];
+            if (a->limit != 0 && b->limit != 0 &&
+                a->start < b->start + extent(b) &&
+                b->start < a->start + extent(a)) {
+                snprintf(error, len, "regions %s and %s overlap", a->name,
+                         b->name);
+                return -1;
+            }
+        }
+    }
+
+    for (i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *region = &MEM_REGIONS[i];
+
+        if (region->limit == 0) {
+            continue;
+        }
+        /* anonymous pages read as zero and only use memory once written */
+        bytes = ((uint64_t)region->limit + 0xfff) & ~0xfffull;
+        region->mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region->mem == MAP_FAILED) {
+            region->mem = NULL;
+            snprintf(error, len, "can't reserve %llu bytes for %s",
+                     (unsigned long long)bytes, region->name);
+            return -1;
+        }
+    }
+    MEM_LAST = &MEM_REGIONS[0];
+    return 0;
+}
+
+void memmap_print(FILE *out) {
+    int i;
+
+    for (i = 0; i < MEM_NREGIONS; i++) {
+        const mem_region_t *region = &MEM_REGIONS[i];
+        fprintf(out, "%-8s 0x%08x  %10u bytes", region->name, region->start,
+                region->size);
+        if (region->limit > region->size) {
+            fprintf(out, " (up to %u)", region->limit);
+        }
+        fprintf(out, "  %c%c\n", region->perms & MEM_READ ? 'r' : '-',
+                region->perms & MEM_WRITE ? 'w' : '-');
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef _SIM_MEMMAP_H_
+#define _SIM_MEMMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define MEMMAP_MAX_REGIONS 16
+
+/// Region permissions. Guest loads and stores outside them stop the
+/// program; the loader and the shell may always write.
+#define MEM_READ  1
+#define MEM_WRITE 2
+
+typedef struct {
+    char name[16];
+    uint32_t start, size;
+
+    /* bytes reserved on the host; only the heap grows its size up to it */
+    uint32_t limit;
+    int perms;
+    uint8_t *mem;
+} mem_region_t;
+
+/// The memory map, the standard SPIM layout until reconfigured:
+///
+///   text  0x00400000  1 MB      data  0x10000000  1 MB
+///   heap  after data, up to the next region, grown by sbrk
+///   stack 0x7ff00000  1 MB      ktext 0x80000000  1 MB
+///   kdata 0x90000000  1 MB
+extern mem_region_t MEM_REGIONS[MEMMAP_MAX_REGIONS];
+extern int MEM_NREGIONS;
+
+/// The region of the last lookup, tried first by the next one.
+extern mem_region_t *MEM_LAST;
+
+/// Change or add a region from a `name=start:size[:perms]` spec, e.g.
+/// `data=0x10000000:256M:rw`. Sizes take K, M and G suffixes, and perms
+/// are any of `r` and `w` (default both). A heap of size 0 starts right
+/// after the data region. Returns -1 with a message in `error` if the
+/// spec is malformed.
+int memmap_set(const char *spec, char *error, size_t len);
+
+/// Apply every spec in a file, one per line; `#` starts a comment.
+int memmap_load(const char *filename, char *error, size_t len);
+
+/// Check the map for overlaps and reserve host memory for each region.
+/// Pages are only backed once the guest touches them, so large regions
+/// cost nothing up front.
+int memmap_map(char *error, size_t len);
+
+/// The region with this name, or NULL.
+mem_region_t *memmap_find(const char *name);
+
+void memmap_print(FILE *out);
+
+/// Region containing `address`, or NULL.
+static inline mem_region_t *memmap_lookup(uint32_t address) {
+    mem_region_t *region = MEM_LAST;
+    int i;
+
+    if (address - region->start < region->size) {
+        return region;
+    }
+    for (i = 0; i < MEM_NREGIONS; i++) {
+        if (address - MEM_REGIONS[i].start < MEM_REGIONS[i].size) {
+            MEM_LAST = &MEM_REGIONS[i];
+            return MEM_LAST;
+        }
+    }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "plugin.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t kinds;
+    sim_plugin_events_t on_events;
+    sim_plugin_exit_t at_exit;
+    void *user;
+} callback_t;
+
+uint32_t PLUGIN_KINDS;
+
+_Thread_local sim_event_t PLUGIN_EVENTS[PLUGIN_BUFFER_EVENTS];
+_Thread_local uint32_t PLUGIN_COUNT;
+
+static callback_t callbacks[PLUGIN_MAX_CALLBACKS];
+static int num_callbacks;
+
+int sim_plugin_register(uint32_t kinds, sim_plugin_events_t on_events,
+                        sim_plugin_exit_t at_exit, void *user) {
+    if (num_callbacks == PLUGIN_MAX_CALLBACKS) {
+        return -1;
+    }
+    callbacks[num_callbacks].kinds = kinds;
+    callbacks[num_callbacks].on_events = on_events;
+    callbacks[num_callbacks].at_exit = at_exit;
+    callbacks[num_callbacks].user = user;
+    num_callbacks++;
+    PLUGIN_KINDS |= kinds;
+    return 0;
+}
+
+void plugin_flush(void) {
+    uint32_t count = PLUGIN_COUNT;
+    int i;
+
+    if (count == 0) {
+        return;
+    }
+    /* reset first, a callback may itself cause a flush */
+    PLUGIN_COUNT = 0;
+    for (i = 0; i < num_callbacks; i++) {
+        if (callbacks[i].on_events != NULL) {
+            callbacks[i].on_events(callbacks[i].user, PLUGIN_EVENTS, count);
+        }
+    }
+}
+
+static void plugin_exit(void) {
+    int i;
+
+    plugin_flush();
+    for (i = 0; i < num_callbacks; i++) {
+        if (callbacks[i].at_exit != NULL) {
+            callbacks[i].at_exit(callbacks[i].user);
+        }
+    }
+}
+
+int plugin_load(const char *spec) {
+    static int registered_exit;
+    int (*init)(int, const char *);
+    const char *args = "";
+    char path[4096], *eq;
+    void *handle;
+
+    if (strlen(spec) >= sizeof(path)) {
+        fprintf(stderr, "Error: plugin path too long\n");
+        return -1;
+    }
+    strcpy(path, spec);
+    if ((eq = strchr(path, '=')) != NULL) {
+        *eq = '\0';
+        args = spec + (eq - path) + 1;
+    }
+    /* dlopen only searches the library path for bare names */
+    if (strchr(path, '/') == NULL && strlen(path) + 2 < sizeof(path)) {
+        memmove(path + 2, path, strlen(path) + 1);
+        memcpy(path, "./", 2);
+    }
+
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        fprintf(stderr, "Error: %s\n", dlerror());
+        return -1;
+    }
+    *(void **)&init = dlsym(handle, "sim_plugin_init");
+    if (init == NULL) {
+        fprintf(stderr, "Error: %s has no sim_plugin_init\n", path);
+        dlclose(handle);
+        return -1;
+    }
+    if (init(SIM_PLUGIN_VERSION, args) != 0) {
+        fprintf(stderr, "Error: %s failed to initialize\n", path);
+        return -1;
+    }
+    if (!registered_exit) {
+        atexit(plugin_exit);
+        registered_exit = 1;
+    }
+    return 0;
+}
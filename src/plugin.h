@@ -0,0 +1,88 @@
+#ifndef _SIM_PLUGIN_H_
+#define _SIM_PLUGIN_H_
+
+#include <stdint.h>
+
+/// Instrumentation plugins are shared objects loaded with `--plugin
+/// file.so[=args]`. Each one exports
+///
+///   int sim_plugin_init(int version, const char *args);
+///
+/// which gets SIM_PLUGIN_VERSION and the text after `=` (or ""), calls
+/// sim_plugin_register() for the events it wants, and returns 0, or
+/// anything else to refuse to load. The simulator is linked with
+/// -rdynamic, so plugins may also call mem_read_32() and isa_disasm() and
+/// read CURRENT_STATE from inside their callbacks.
+///
+/// Events are not delivered one call per instruction. They are collected
+/// in a buffer per simulation thread and handed over in batches: when the
+/// buffer fills, at the end of every run of the worker and when the
+/// simulator exits. With no plugin loaded nothing is recorded and the
+/// plain interpreter runs unchanged.
+#define SIM_PLUGIN_VERSION 1
+
+/// Event kinds, also the bits of the mask passed to sim_plugin_register.
+#define SIM_EVENT_BLOCK     0x01 /* pc starts a block, after a control transfer */
+#define SIM_EVENT_INSN      0x02 /* addr: instruction word, value: isa_id_t */
+#define SIM_EVENT_MEM_READ  0x04 /* addr, size in bytes, value: word loaded */
+#define SIM_EVENT_MEM_WRITE 0x08 /* addr, size in bytes, value: value stored */
+#define SIM_EVENT_SYSCALL   0x10 /* addr: $v0, value: $a0, before it runs */
+
+typedef struct {
+    uint16_t kind;
+    uint16_t size;
+    uint32_t pc;
+    uint32_t addr;
+    uint32_t value;
+} sim_event_t;
+
+/// Receives a batch of events in execution order. A batch holds the events
+/// of every plugin, so it can contain kinds this callback did not ask for.
+typedef void (*sim_plugin_events_t)(void *user, const sim_event_t *events,
+                                    uint32_t count);
+
+/// Called once when the simulator exits, after the last batch.
+typedef void (*sim_plugin_exit_t)(void *user);
+
+/// Subscribe to the event kinds in `kinds`. `at_exit` may be NULL. Returns
+/// -1 when too many callbacks are registered.
+int sim_plugin_register(uint32_t kinds, sim_plugin_events_t on_events,
+                        sim_plugin_exit_t at_exit, void *user);
+
+/* The rest is the simulator's side. */
+
+#define PLUGIN_MAX_CALLBACKS 16
+#define PLUGIN_BUFFER_EVENTS 4096
+
+/// Union of the kinds registered, 0 while no plugin is loaded.
+extern uint32_t PLUGIN_KINDS;
+
+extern _Thread_local sim_event_t PLUGIN_EVENTS[PLUGIN_BUFFER_EVENTS];
+extern _Thread_local uint32_t PLUGIN_COUNT;
+
+/// Load a plugin from a `file.so[=args]` spec. Returns -1 and prints why if
+/// it can't be loaded or refuses.
+int plugin_load(const char *spec);
+
+/// Deliver the events buffered by the calling thread.
+void plugin_flush(void);
+
+static inline void plugin_record(uint32_t kind, uint32_t size, uint32_t pc,
+                                 uint32_t addr, uint32_t value) {
+    sim_event_t *event;
+
+    if ((PLUGIN_KINDS & kind) == 0) {
+        return;
+    }
+    event = &PLUGIN_EVENTS[PLUGIN_COUNT];
+    event->kind = kind;
+    event->size = size;
+    event->pc = pc;
+    event->addr = addr;
+    event->value = value;
+    if (++PLUGIN_COUNT == PLUGIN_BUFFER_EVENTS) {
+        plugin_flush();
+    }
+}
+
+#endif
@@ -0,0 +1,737 @@
+#define _GNU_SOURCE /* pipe2 */
+
+#include "regress.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coverage.h"
+#include "isa.h"
+#include "memmap.h"
+
+#define REGRESS_MAX_RANGES 16
+#define REGRESS_MAX_DIFFS 8          /* differing lines shown per run */
+#define REGRESS_DEFAULT_LIMIT 10000000
+#define REGRESS_DEFAULT_RANGE 0x1000 /* bytes at the start of "data" */
+#define REGRESS_TIMEOUT "60"         /* seconds, for an engine that hangs */
+#define REGRESS_TRACE_CHUNK 4096     /* trace records compared per read */
+
+extern char **environ;
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} text_t;
+
+/* how a program is run, from the golden file or the command line */
+typedef struct {
+    int64_t limit;
+    uint32_t ranges[REGRESS_MAX_RANGES][2];
+    int num_ranges;
+} params_t;
+
+typedef struct {
+    char *program, *golden;
+    char *coverage; /* <stem>.cov with --coverage, else NULL */
+    int failed;
+    text_t report;
+} job_t;
+
+/* a "key value" line of a state, the key of memory lines includes the
+ * address */
+typedef struct {
+    const char *key, *value;
+    int key_len, value_len;
+} line_t;
+
+/* the child argument vector, see make_args() */
+typedef struct {
+    char *argv[16 + 2 * REGRESS_MAX_RANGES];
+    char words[2 + REGRESS_MAX_RANGES][32];
+    int argc;
+} args_t;
+
+static char exe[4096];
+static const char *engine;
+static int record, coverage;
+static params_t defaults;
+
+static job_t *jobs;
+static int num_jobs, jobs_cap;
+static atomic_int next_job;
+
+static void text_printf(text_t *text, const char *format, ...) {
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    n = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (text->len + n + 1 > text->cap) {
+        text->cap = (text->len + n + 1) * 2;
+        text->buf = realloc(text->buf, text->cap);
+    }
+    va_start(args, format);
+    vsnprintf(text->buf + text->len, n + 1, format, args);
+    va_end(args);
+    text->len += n;
+}
+
+/* Append everything up to end of file on `fd`. */
+static void text_read(text_t *text, int fd) {
+    ssize_t n;
+
+    do {
+        if (text->cap - text->len < 4096) {
+            text->cap = text->cap * 2 + 4096;
+            text->buf = realloc(text->buf, text->cap);
+        }
+        n = read(fd, text->buf + text->len, text->cap - text->len - 1);
+        if (n > 0) {
+            text->len += n;
+        }
+    } while (n > 0);
+    text->buf[text->len] = '\0';
+}
+
+/* Read up to `size` bytes, fewer only at end of file. */
+static size_t read_full(int fd, void *buf, size_t size) {
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < size && (n = read(fd, (char *)buf + done, size - done)) > 0) {
+        done += n;
+    }
+    return done;
+}
+
+/* Start a child simulator with its stdio on /dev/null and the write end of
+ * a pipe as fd 3, which --state and --trace-state write to as /dev/fd/3.
+ * Returns the pid and the read end in *fd, or -1. */
+static pid_t spawn(char *argv[], int *fd) {
+    posix_spawn_file_actions_t actions;
+    int fds[2], moved;
+    pid_t pid;
+
+    /* close-on-exec, or the other workers' children would hold it open */
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    /* dup2 onto itself would leave close-on-exec set */
+    if (fds[1] == 3) {
+        moved = fcntl(fds[1], F_DUPFD_CLOEXEC, 4);
+        close(fds[1]);
+        fds[1] = moved;
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 3);
+    if (posix_spawn(&pid, exe, &actions, NULL, argv, environ) != 0) {
+        pid = -1;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    *fd = fds[0];
+    return pid;
+}
+
+static void args_add(args_t *args, char *arg) {
+    args->argv[args->argc++] = arg;
+    args->argv[args->argc] = NULL;
+}
+
+/* Arguments to run `program` with `interp` for at most `limit`
+ * instructions, writing `output` (--state or --trace-state) to fd 3, and
+ * its coverage to `cov` unless that is NULL. */
+static void make_args(args_t *args, const char *program, const char *interp,
+                      const params_t *params, int64_t limit,
+                      const char *output, const char *cov) {
+    int i;
+
+    args->argc = 0;
+    args_add(args, exe);
+    if (cov != NULL) {
+        args_add(args, "--coverage");
+        args_add(args, (char *)cov);
+    }
+    args_add(args, "--interp");
+    args_add(args, (char *)interp);
+    args_add(args, "--max-seconds");
+    args_add(args, REGRESS_TIMEOUT);
+    args_add(args, "--max-insns");
+    snprintf(args->words[0], sizeof(args->words[0]), "%lld",
+             (long long)limit);
+    args_add(args, args->words[0]);
+    args_add(args, (char *)output);
+    args_add(args, "/dev/fd/3");
+    for (i = 0; i < params->num_ranges; i++) {
+        snprintf(args->words[i + 1], sizeof(args->words[i + 1]),
+                 "0x%08x:0x%08x", params->ranges[i][0], params->ranges[i][1]);
+        args_add(args, "--state-mem");
+        args_add(args, args->words[i + 1]);
+    }
+    args_add(args, (char *)program);
+}
+
+/* Run `program` to its final state, or explain in the job's report why
+ * there is none. */
+static int run_state(job_t *job, const char *interp, const params_t *params,
+                     int64_t limit, const char *cov, text_t *state) {
+    args_t args;
+    int fd, status;
+    pid_t pid;
+
+    make_args(&args, job->program, interp, params, limit, "--state", cov);
+    if ((pid = spawn(args.argv, &fd)) < 0) {
+        text_printf(&job->report, "  can't run %s\n", exe);
+        return -1;
+    }
+    state->len = 0;
+    text_read(state, fd);
+    close(fd);
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status)) {
+        text_printf(&job->report, "  %s interpreter killed by signal %d\n",
+                    interp, WTERMSIG(status));
+        return -1;
+    }
+    if (state->len == 0) {
+        text_printf(&job->report, "  %s interpreter wrote no state, exit %d\n",
+                    interp, WEXITSTATUS(status));
+        return -1;
+    }
+    return 0;
+}
+
+/* The next state line from *pos, skipping comments and the run
+ * parameters at the top of golden files. */
+static int next_line(const text_t *text, size_t *pos, line_t *line) {
+    const char *start, *end, *space;
+
+    while (*pos < text->len) {
+        start = text->buf + *pos;
+        if ((end = memchr(start, '\n', text->len - *pos)) == NULL) {
+            end = text->buf + text->len;
+        }
+        *pos = end - text->buf + 1;
+        if (start == end || *start == '#' || strncmp(start, "limit ", 6) == 0 ||
+            strncmp(start, "range ", 6) == 0) {
+            continue;
+        }
+        space = memchr(start, ' ', end - start);
+        if (space != NULL && strncmp(start, "mem ", 4) == 0) {
+            space = memchr(space + 1, ' ', end - space - 1);
+        }
+        if (space == NULL) {
+            space = end;
+        }
+        line->key = start;
+        line->key_len = space - start;
+        line->value = space < end ? space + 1 : end;
+        line->value_len = end - line->value;
+        return 1;
+    }
+    return 0;
+}
+
+static int is_mem(const line_t *line) {
+    return strncmp(line->key, "mem ", 4) == 0;
+}
+
+/* Whether the line `a` sorts before `b`. Registers come first in a fixed
+ * order, then memory by address. */
+static int line_before(const line_t *a, const line_t *b) {
+    if (is_mem(a) != is_mem(b)) {
+        return !is_mem(a);
+    }
+    if (is_mem(a)) {
+        return strtoul(a->key + 4, NULL, 0) < strtoul(b->key + 4, NULL, 0);
+    }
+    return 1;
+}
+
+static void report_diff(text_t *report, int diffs, const line_t *line,
+                        const char *a_name, const char *a_value, int a_len,
+                        const char *b_name, const char *b_value, int b_len) {
+    if (diffs <= REGRESS_MAX_DIFFS) {
+        text_printf(report, "  %.*s: %s %.*s, %s %.*s\n", line->key_len,
+                    line->key, a_name, a_len, a_value, b_name, b_len, b_value);
+    }
+}
+
+/* Compare two states line by line, reporting the lines that differ.
+ * Memory words missing from one side are zero. Returns how many differ. */
+static int diff_states(text_t *report, const text_t *a, const char *a_name,
+                       const text_t *b, const char *b_name) {
+    size_t a_pos = 0, b_pos = 0;
+    int has_a, has_b, diffs = 0;
+    const char *missing;
+    line_t la, lb;
+
+    has_a = next_line(a, &a_pos, &la);
+    has_b = next_line(b, &b_pos, &lb);
+    while (has_a || has_b) {
+        if (has_a && has_b && la.key_len == lb.key_len &&
+            memcmp(la.key, lb.key, la.key_len) == 0) {
+            if (la.value_len != lb.value_len ||
+                memcmp(la.value, lb.value, la.value_len) != 0) {
+                report_diff(report, ++diffs, &la, a_name, la.value,
+                            la.value_len, b_name, lb.value, lb.value_len);
+            }
+            has_a = next_line(a, &a_pos, &la);
+            has_b = next_line(b, &b_pos, &lb);
+        } else if (has_a && (!has_b || line_before(&la, &lb))) {
+            missing = is_mem(&la) ? "0x00000000" : "none";
+            report_diff(report, ++diffs, &la, a_name, la.value, la.value_len,
+                        b_name, missing, strlen(missing));
+            has_a = next_line(a, &a_pos, &la);
+        } else {
+            missing = is_mem(&lb) ? "0x00000000" : "none";
+            report_diff(report, ++diffs, &lb, a_name, missing,
+                        strlen(missing), b_name, lb.value, lb.value_len);
+            has_b = next_line(b, &b_pos, &lb);
+        }
+    }
+    if (diffs > REGRESS_MAX_DIFFS) {
+        text_printf(report, "  ... %d more\n", diffs - REGRESS_MAX_DIFFS);
+    }
+    return diffs;
+}
+
+/* Run the plain interpreter and the engine under test side by side, each
+ * writing a record per instruction, and report the first instruction after
+ * which they disagree, with the state of both just after it. */
+static void locate(job_t *job, const params_t *params) {
+    const char *names[2] = { "plain", engine };
+    uint32_t *records[2], inst = 0, pc = 0;
+    size_t count[2], n, i;
+    uint64_t index = 0;
+    text_t states[2] = { { 0 } };
+    args_t args;
+    int fds[2], k, status;
+    pid_t pids[2];
+    char text[64];
+
+    for (k = 0; k < 2; k++) {
+        make_args(&args, job->program, k == 0 ? "plain" : engine, params,
+                  params->limit, "--trace-state", NULL);
+        if ((pids[k] = spawn(args.argv, &fds[k])) < 0) {
+            text_printf(&job->report, "  can't run %s\n", exe);
+            if (k == 1) {
+                kill(pids[0], SIGKILL);
+                close(fds[0]);
+                waitpid(pids[0], &status, 0);
+                free(records[0]);
+            }
+            return;
+        }
+        records[k] = malloc(REGRESS_TRACE_CHUNK * 3 * sizeof(uint32_t));
+    }
+
+    /* records are (PC, instruction, hash of the state after it) */
+    for (;;) {
+        for (k = 0; k < 2; k++) {
+            count[k] = read_full(fds[k], records[k],
+                                 REGRESS_TRACE_CHUNK * 3 * sizeof(uint32_t)) /
+                       (3 * sizeof(uint32_t));
+        }
+        n = count[0] < count[1] ? count[0] : count[1];
+        for (i = 0; i < n && memcmp(records[0] + i * 3, records[1] + i * 3,
+                                    3 * sizeof(uint32_t)) == 0;
+             i++) {
+        }
+        index += i;
+        if (i < n || count[0] != count[1] || n == 0) {
+            break;
+        }
+    }
+    if (i < n) {
+        pc = records[0][i * 3];
+        inst = records[0][i * 3 + 1];
+    }
+    for (k = 0; k < 2; k++) {
+        kill(pids[k], SIGKILL);
+        close(fds[k]);
+        waitpid(pids[k], &status, 0);
+        free(records[k]);
+    }
+
+    if (i < n) {
+        isa_disasm(inst, pc, text, sizeof(text));
+        text_printf(&job->report,
+                    "  first difference at instruction %llu, PC 0x%08x: %s\n",
+                    (unsigned long long)index + 1, pc, text);
+        if (run_state(job, "plain", params, index + 1, NULL, &states[0]) ==
+                0 &&
+            run_state(job, engine, params, index + 1, NULL, &states[1]) == 0) {
+            diff_states(&job->report, &states[0], "plain", &states[1],
+                        engine);
+        }
+        free(states[0].buf);
+        free(states[1].buf);
+    } else if (count[0] != count[1]) {
+        k = count[0] < count[1];
+        text_printf(&job->report,
+                    "  %s stops after %llu instructions, %s runs on\n",
+                    names[!k], (unsigned long long)index, names[k]);
+    } else {
+        text_printf(&job->report,
+                    "  plain and %s agree on every instruction, so the "
+                    "golden state is out of date\n", engine);
+    }
+}
+
+static int read_file(const char *filename, text_t *text) {
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return -1;
+    }
+    text_read(text, fd);
+    close(fd);
+    return 0;
+}
+
+/* Take the limit and ranges from the top of a golden file. */
+static void read_params(const text_t *golden, params_t *params) {
+    const char *line = golden->buf;
+    unsigned int lo, hi;
+    long long limit;
+
+    params->limit = defaults.limit;
+    params->num_ranges = 0;
+    while (line != NULL && *line != '\0') {
+        if (sscanf(line, "limit %lld", &limit) == 1) {
+            params->limit = limit;
+        } else if (sscanf(line, "range %i %i", &lo, &hi) == 2 &&
+                   params->num_ranges < REGRESS_MAX_RANGES) {
+            params->ranges[params->num_ranges][0] = lo;
+            params->ranges[params->num_ranges][1] = hi;
+            params->num_ranges++;
+        }
+        if ((line = strchr(line, '\n')) != NULL) {
+            line++;
+        }
+    }
+}
+
+static void write_golden(job_t *job, const text_t *state) {
+    FILE *out;
+    int i;
+
+    if ((out = fopen(job->golden, "w")) == NULL) {
+        text_printf(&job->report, "  can't write %s\n", job->golden);
+        job->failed = 1;
+        return;
+    }
+    fprintf(out, "# final state of %s, from sim --regress --record\n",
+            job->program);
+    fprintf(out, "limit %lld\n", (long long)defaults.limit);
+    for (i = 0; i < defaults.num_ranges; i++) {
+        fprintf(out, "range 0x%08x 0x%08x\n", defaults.ranges[i][0],
+                defaults.ranges[i][1]);
+    }
+    fwrite(state->buf, 1, state->len, out);
+    if (fclose(out) != 0) {
+        text_printf(&job->report, "  can't write %s\n", job->golden);
+        job->failed = 1;
+    }
+}
+
+/* Add the coverage of this run to the program's earlier runs in
+ * <stem>.cov, or start it afresh if the program has changed since. */
+static void merge_coverage(job_t *job, const char *run_cov) {
+    coverage_t cov = { 0 };
+
+    if (access(run_cov, F_OK) != 0) {
+        return;
+    }
+    if (coverage_load(&cov, run_cov) == 0 &&
+        access(job->coverage, F_OK) == 0 &&
+        coverage_load(&cov, job->coverage) != 0) {
+        coverage_free(&cov);
+        coverage_load(&cov, run_cov);
+    }
+    if (cov.bits != NULL && coverage_save(&cov, job->coverage) != 0) {
+        text_printf(&job->report, "  can't write %s\n", job->coverage);
+    }
+    coverage_free(&cov);
+    unlink(run_cov);
+}
+
+static void run_job(job_t *job) {
+    text_t golden = { 0 }, state = { 0 };
+    char run_cov[4096];
+    params_t params;
+
+    if (record) {
+        /* the reference is always the plain interpreter */
+        if (run_state(job, "plain", &defaults, defaults.limit, NULL,
+                      &state) == 0) {
+            write_golden(job, &state);
+        } else {
+            job->failed = 1;
+        }
+    } else if (read_file(job->golden, &golden) != 0) {
+        text_printf(&job->report,
+                    "  no %s, record one with --regress --record\n",
+                    job->golden);
+        job->failed = 1;
+    } else {
+        read_params(&golden, &params);
+        if (job->coverage != NULL) {
+            snprintf(run_cov, sizeof(run_cov), "%s.run", job->coverage);
+        }
+        if (run_state(job, engine, &params, params.limit,
+                      job->coverage != NULL ? run_cov : NULL, &state) != 0 ||
+            diff_states(&job->report, &golden, "golden", &state, engine) != 0) {
+            job->failed = 1;
+            if (strcmp(engine, "plain") != 0) {
+                locate(job, &params);
+            }
+        }
+        if (job->coverage != NULL) {
+            merge_coverage(job, run_cov);
+        }
+    }
+    free(golden.buf);
+    free(state.buf);
+}
+
+static void *worker(void *arg) {
+    int i;
+
+    while ((i = atomic_fetch_add(&next_job, 1)) < num_jobs) {
+        run_job(&jobs[i]);
+    }
+    return NULL;
+}
+
+static void add_job(const char *program) {
+    const char *slash = strrchr(program, '/');
+    const char *dot = strrchr(slash != NULL ? slash : program, '.');
+    size_t stem = dot != NULL ? (size_t)(dot - program) : strlen(program);
+    job_t *job;
+
+    if (num_jobs == jobs_cap) {
+        jobs_cap = jobs_cap ? jobs_cap * 2 : 64;
+        jobs = realloc(jobs, jobs_cap * sizeof(job_t));
+    }
+    job = &jobs[num_jobs++];
+    memset(job, 0, sizeof(*job));
+    job->program = strdup(program);
+    job->golden = malloc(stem + sizeof(".golden"));
+    memcpy(job->golden, program, stem);
+    strcpy(job->golden + stem, ".golden");
+    if (coverage) {
+        job->coverage = malloc(stem + sizeof(".cov"));
+        memcpy(job->coverage, program, stem);
+        strcpy(job->coverage + stem, ".cov");
+    }
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int has_suffix(const char *name, const char *suffix) {
+    size_t n = strlen(name), k = strlen(suffix);
+
+    return n > k && strcmp(name + n - k, suffix) == 0;
+}
+
+/* Add a program, or the programs in a directory in name order: every .x
+ * file, and every .s file without a .x of the same name. */
+static int add_path(const char *path) {
+    char **names = NULL, *name;
+    int num_names = 0, i;
+    struct dirent *entry;
+    struct stat info;
+    DIR *dir;
+
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "Error: Can't open %s\n", path);
+        return -1;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        add_job(path);
+        return 0;
+    }
+    if ((dir = opendir(path)) == NULL) {
+        fprintf(stderr, "Error: Can't open %s\n", path);
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (!has_suffix(entry->d_name, ".x") &&
+            !has_suffix(entry->d_name, ".s")) {
+            continue;
+        }
+        name = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(name, "%s/%s", path, entry->d_name);
+        if (has_suffix(name, ".s")) {
+            name[strlen(name) - 1] = 'x';
+            if (access(name, F_OK) == 0) {
+                free(name);
+                continue;
+            }
+            name[strlen(name) - 1] = 's';
+        }
+        names = realloc(names, (num_names + 1) * sizeof(char *));
+        names[num_names++] = name;
+    }
+    closedir(dir);
+    qsort(names, num_names, sizeof(char *), by_name);
+    for (i = 0; i < num_names; i++) {
+        add_job(names[i]);
+        free(names[i]);
+    }
+    free(names);
+    return 0;
+}
+
+int regress_main(int argc, char *argv[], const char *interp) {
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN), failed = 0, i;
+    struct timespec start, end;
+    mem_region_t *data;
+    pthread_t *threads;
+    ssize_t n;
+    char *end_ptr;
+
+    engine = interp;
+    defaults.limit = REGRESS_DEFAULT_LIMIT;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--record") == 0) {
+            record = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--coverage") == 0) {
+            coverage = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Error: %s needs a value\n", argv[i]);
+            return 2;
+        }
+        if (strcmp(argv[i], "-j") == 0) {
+            num_threads = strtol(argv[++i], &end_ptr, 0);
+            if (*end_ptr != '\0' || num_threads < 1) {
+                fprintf(stderr, "Error: bad thread count %s\n", argv[i]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--max-insns") == 0) {
+            defaults.limit = strtoll(argv[++i], &end_ptr, 0);
+            if (*end_ptr != '\0' || defaults.limit < 1) {
+                fprintf(stderr, "Error: bad instruction count %s\n", argv[i]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--range") == 0) {
+            if (defaults.num_ranges == REGRESS_MAX_RANGES) {
+                fprintf(stderr, "Error: at most %d memory ranges\n",
+                        REGRESS_MAX_RANGES);
+                return 2;
+            }
+            defaults.ranges[defaults.num_ranges][0] =
+                strtoul(argv[++i], &end_ptr, 0);
+            if (*end_ptr == ':') {
+                defaults.ranges[defaults.num_ranges][1] =
+                    strtoul(end_ptr + 1, &end_ptr, 0);
+            } else {
+                end_ptr = "-"; /* not a range */
+            }
+            if (*end_ptr != '\0') {
+                fprintf(stderr, "Error: expected --range lo:hi, got %s\n",
+                        argv[i]);
+                return 2;
+            }
+            defaults.num_ranges++;
+        } else {
+            fprintf(stderr, "Error: unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    /* the coverage interpreter has nowhere to write without --coverage */
+    if (strcmp(engine, "coverage") == 0) {
+        coverage = 1;
+    }
+    if (coverage && record) {
+        fprintf(stderr, "Error: --record runs the plain interpreter, "
+                        "--coverage can't be used with it\n");
+        return 2;
+    }
+    if (coverage && strcmp(engine, "plain") != 0 &&
+        strcmp(engine, "coverage") != 0) {
+        fprintf(stderr, "Error: --coverage checks with the coverage "
+                        "interpreter, not %s\n", engine);
+        return 2;
+    }
+    if (coverage) {
+        engine = "coverage";
+    }
+    /* by default the start of the data segment, where tests keep results */
+    if (defaults.num_ranges == 0 && (data = memmap_find("data")) != NULL) {
+        defaults.ranges[0][0] = data->start;
+        defaults.ranges[0][1] = data->start + REGRESS_DEFAULT_RANGE - 4;
+        defaults.num_ranges = 1;
+    }
+    if (i == argc) {
+        fprintf(stderr, "Error: no programs to check\n");
+        return 2;
+    }
+    for (; i < argc; i++) {
+        if (add_path(argv[i]) != 0) {
+            return 2;
+        }
+    }
+    if ((n = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) < 0) {
+        fprintf(stderr, "Error: Can't find the simulator executable\n");
+        return 2;
+    }
+    exe[n] = '\0';
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (num_threads > num_jobs) {
+        num_threads = num_jobs;
+    }
+    threads = malloc(num_threads * sizeof(pthread_t));
+    for (i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, worker, NULL);
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (i = 0; i < num_jobs; i++) {
+        if (jobs[i].failed) {
+            printf("FAIL %s\n%s", jobs[i].program,
+                   jobs[i].report.len != 0 ? jobs[i].report.buf : "");
+            failed++;
+        }
+    }
+    printf("%s %d programs with %s, %d failed, %.3f s on %d threads\n",
+           record ? "Recorded" : "Checked", num_jobs,
+           record ? "plain" : engine, failed,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+           num_threads);
+    return failed != 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _SIM_REGRESS_H_
+#define _SIM_REGRESS_H_
+
+/// Golden-state regression runs over tests/ and inputs/.
+///
+///   sim [--interp mode] --regress [--record | --coverage] [-j N]
+///       [--max-insns N] [--range lo:hi]... dir|program...
+///
+/// Each program (a .x file, or a .s file with no .x beside it) is run
+/// headless to halt or the instruction limit, and its final state (the
+/// instruction count, exit code, PC, registers, HI/LO, a hash of the
+/// console output and the nonzero words of the selected memory ranges) is
+/// compared with `<stem>.golden` next to it. `--record` writes the golden
+/// files instead, using the plain interpreter; the limit and ranges are
+/// stored in them, so checking needs only the paths.
+///
+/// The simulator keeps one machine in globals, so programs are not run on
+/// the worker threads themselves: each of the N threads (one per CPU by
+/// default) takes the next program and runs it in a child simulator, which
+/// also keeps a crashing engine from taking the harness down.
+///
+/// `--coverage`, or `--interp coverage`, checks with the coverage
+/// interpreter and adds each run's coverage to `<stem>.cov`, which is
+/// started afresh when the program no longer matches it.
+///
+/// Programs are checked with the interpreter selected by --interp. When
+/// one fails and that is not the plain interpreter, both run again side by
+/// side, writing a hash of the state after every instruction, and the
+/// first instruction at which they disagree (in the registers or in what it
+/// stored) is reported with the registers and memory words that differ just
+/// after it.
+///
+/// Returns the exit status: 0 when every program matches, 1 when some do
+/// not and 2 for bad arguments.
+int regress_main(int argc, char *argv[], const char *interp);
+
+#endif
@@ -11,51 +11,141 @@
 /* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!! */
 
 #include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "shell.h"
+#include "asm.h"
+#include "aot.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "lockstep.h"
+#include "isa.h"
+#include "syscall.h"
+#include "memmap.h"
+#include "plugin.h"
+#include "coverage.h"
+#include "regress.h"
 
 /***************************************************************/
 /* Main memory.                                                */
 /***************************************************************/
 
-#define MEM_DATA_START  0x10000000
-#define MEM_DATA_SIZE   0x00100000
-#define MEM_TEXT_START  0x00400000
-#define MEM_TEXT_SIZE   0x00100000
-#define MEM_STACK_START 0x7ff00000
-#define MEM_STACK_SIZE  0x00100000
-#define MEM_KDATA_START 0x90000000
-#define MEM_KDATA_SIZE  0x00100000
-#define MEM_KTEXT_START 0x80000000
-#define MEM_KTEXT_SIZE  0x00100000
+/* regions and their host memory live in memmap.c */
 
+/***************************************************************/
+/* CPU State info.                                             */
+/***************************************************************/
+
+CPU_State CURRENT_STATE, NEXT_STATE;
+int RUN_BIT;	/* run bit */
+int FAULTED;
+uint64_t *STORE_HASH;
+uint64_t INSTRUCTION_COUNT;
+
+/* symbols of the last program assembled from source */
+asm_program_t PROGRAM_SYMBOLS;
+
+/* end of the loaded text segment, the range handed to the translator */
+uint32_t PROGRAM_TEXT_END;
+
+/***************************************************************/
+/* Simulation worker.                                          */
+/***************************************************************/
+
+/* instructions between checks for a stop request */
+#define STOP_CHECK_INTERVAL 4096
+
+pthread_t SIM_THREAD;
+int SIM_JOINABLE;           /* SIM_THREAD has not been joined yet */
+int64_t SIM_LIMIT;          /* instructions to run, negative for no limit */
+atomic_int SIM_RUNNING;     /* the worker is executing instructions */
+atomic_int STOP_REQUEST;    /* set by `stop` and Ctrl-C */
+_Atomic uint64_t PUBLISHED_COUNT; /* INSTRUCTION_COUNT as of the last batch */
+
+/* why the worker stopped before its limit */
+#define STOP_NONE  0
+#define STOP_BREAK 1
+#define STOP_WATCH 2
+#define STOP_TIME  3
+
+int STOP_REASON;
+int STEP_OVER_BREAK; /* don't stop on a breakpoint at the resume PC */
+uint32_t WATCH_HIT_PC;
+
+/* start of the interval measured by `status` */
+struct timespec STATUS_TIME;
+uint64_t STATUS_COUNT;
+
+/* stdin is a terminal, so `go` runs in the background */
+int INTERACTIVE;
+
+/* the program has read the console, so `go` waits for it from now on */
+int READS_CONSOLE;
+
+/* file to write the coverage of the program to, from --coverage */
+char *COVERAGE_PATH;
+
+/* running without the shell, see run_headless() */
+int HEADLESS;
+struct timespec SIM_DEADLINE; /* stop here when tv_sec is not 0 */
+
+/* exit status of a headless run cut short, like timeout(1) */
+#define EXIT_TIME_LIMIT 124
+#define EXIT_INSN_LIMIT 125
+#define EXIT_STOPPED    130
+/* the program stopped on a memory fault or an unimplemented instruction */
+#define EXIT_FAULT      126
+
+/* interpreter variants selectable with `mode`, all generated from isa.def */
 typedef struct {
-    uint32_t start, size;
-    uint8_t *mem;
-} mem_region_t;
-
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-    { MEM_TEXT_START, MEM_TEXT_SIZE, NULL },
-    { MEM_DATA_START, MEM_DATA_SIZE, NULL },
-    { MEM_STACK_START, MEM_STACK_SIZE, NULL },
-    { MEM_KDATA_START, MEM_KDATA_SIZE, NULL },
-    { MEM_KTEXT_START, MEM_KTEXT_SIZE, NULL }
+  const char *name;
+  void (*run)();
+} interp_mode_t;
+
+interp_mode_t INTERP_MODES[] = {
+  { "plain", process_instruction },
+  { "trace", process_instruction_traced },
+  { "stats", process_instruction_stats },
+  { "timing", process_instruction_timing },
+  { "plugin", process_instruction_plugin },
+  { "coverage", process_instruction_coverage },
 };
 
-#define MEM_NREGIONS (sizeof(MEM_REGIONS)/sizeof(mem_region_t))
+#define NUM_INTERP_MODES (sizeof(INTERP_MODES)/sizeof(interp_mode_t))
+
+/* the variant cycle() runs */
+void (*INTERPRETER)() = process_instruction;
+int INTERP_MODE;
+
+#ifdef SIM_AOT
+/* instructions run by translated code between stop checks */
+#define AOT_BUDGET 0x100000
+
+/* set when the translation linked in matches the loaded program */
+int AOT_ENABLED;
+#endif
 
 /***************************************************************/
-/* CPU State info.                                             */
+/*                                                             */
+/* Procedure: mem_byte                                         */
+/*                                                             */
+/* Purpose: Host address of one byte of memory, or NULL        */
+/*                                                             */
 /***************************************************************/
+static uint8_t *mem_byte(uint32_t address)
+{
+    mem_region_t *region = memmap_lookup(address);
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_BIT;	/* run bit */
-int INSTRUCTION_COUNT;
+    return region != NULL ? region->mem + (address - region->start) : NULL;
+}
 
 /***************************************************************/
 /*                                                             */
@@ -66,21 +156,27 @@ int INSTRUCTION_COUNT;
 /***************************************************************/
 uint32_t mem_read_32(uint32_t address)
 {
+    mem_region_t *region = memmap_lookup(address);
+    uint32_t value = 0;
+    uint8_t *byte;
     int i;
-    for (i = 0; i < MEM_NREGIONS; i++) {
-        if (address >= MEM_REGIONS[i].start &&
-                address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-            uint32_t offset = address - MEM_REGIONS[i].start;
-
-            return
-                (MEM_REGIONS[i].mem[offset+3] << 24) |
-                (MEM_REGIONS[i].mem[offset+2] << 16) |
-                (MEM_REGIONS[i].mem[offset+1] <<  8) |
-                (MEM_REGIONS[i].mem[offset+0] <<  0);
-        }
+
+    if (region != NULL && address - region->start <= region->size - 4) {
+        uint32_t offset = address - region->start;
+
+        return
+            (region->mem[offset+3] << 24) |
+            (region->mem[offset+2] << 16) |
+            (region->mem[offset+1] <<  8) |
+            (region->mem[offset+0] <<  0);
     }
 
-    return 0;
+    /* a word across the end of a region: each byte from its own region,
+     * since the host mappings may lie back to back */
+    for (i = 0; i < 4; i++)
+        if ((byte = mem_byte(address + i)) != NULL)
+            value |= *byte << (8 * i);
+    return value;
 }
 
 /***************************************************************/
@@ -90,159 +186,1068 @@ uint32_t mem_read_32(uint32_t address)
 /* Purpose: Write a 32-bit word to memory                      */
 /*                                                             */
 /***************************************************************/
-void mem_write_32(uint32_t address, uint32_t value)
-{
-    int i;
-    for (i = 0; i < MEM_NREGIONS; i++) {
-        if (address >= MEM_REGIONS[i].start &&
-                address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-            uint32_t offset = address - MEM_REGIONS[i].start;
-
-            MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-            MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-            MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-            MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
-            return;
-        }
+void mem_write_32(uint32_t address, uint32_t value)
+{
+    mem_region_t *region;
+    uint8_t *byte;
+    int i;
+
+    if (CHECKPOINT_INTERVAL != 0)
+        checkpoint_write_hook(address);
+    if (STORE_HASH != NULL)
+        *STORE_HASH = (((*STORE_HASH ^ address) * SYSCALL_HASH_PRIME) ^
+                       value) * SYSCALL_HASH_PRIME;
+    if ((region = memmap_lookup(address)) != NULL &&
+        address - region->start <= region->size - 4) {
+        uint32_t offset = address - region->start;
+
+        region->mem[offset+3] = (value >> 24) & 0xFF;
+        region->mem[offset+2] = (value >> 16) & 0xFF;
+        region->mem[offset+1] = (value >>  8) & 0xFF;
+        region->mem[offset+0] = (value >>  0) & 0xFF;
+        return;
+    }
+
+    /* across the end of a region, as in mem_read_32 */
+    if (CHECKPOINT_INTERVAL != 0)
+        checkpoint_write_hook(address + 3);
+    for (i = 0; i < 4; i++)
+        if ((byte = mem_byte(address + i)) != NULL)
+            *byte = (value >> (8 * i)) & 0xFF;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_fault                                        */
+/*                                                             */
+/* Purpose: Stop the program after a load or store the memory  */
+/*          map does not permit                                */
+/*                                                             */
+/***************************************************************/
+void mem_fault(uint32_t address, int access)
+{
+    syscall_flush();
+    printf("Memory fault: %s 0x%08x at PC 0x%08x\n",
+           access == MEM_WRITE ? "write to" : "read from", address,
+           CURRENT_STATE.PC);
+    RUN_BIT = FALSE;
+    FAULTED = TRUE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: insn_fault                                       */
+/*                                                             */
+/* Purpose: Stop the program on a word that is not an          */
+/*          instruction the interpreter knows                  */
+/*                                                             */
+/***************************************************************/
+void insn_fault(uint32_t inst, uint32_t pc)
+{
+    syscall_flush();
+    printf("unimplemented instruction: 0x%08x at PC 0x%08x\n", inst, pc);
+    RUN_BIT = FALSE;
+    FAULTED = TRUE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: div_fault                                        */
+/*                                                             */
+/* Purpose: Stop the program on a division the host would trap */
+/*          on, rather than let it kill the simulator          */
+/*                                                             */
+/***************************************************************/
+void div_fault(uint32_t pc)
+{
+    syscall_flush();
+    printf("Division fault: divide by zero or overflow at PC 0x%08x\n", pc);
+    RUN_BIT = FALSE;
+    FAULTED = TRUE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_ptr                                          */
+/*                                                             */
+/* Purpose: Host address of simulated memory, for bulk access  */
+/*                                                             */
+/***************************************************************/
+uint8_t *mem_ptr(uint32_t address, uint32_t *avail)
+{
+    mem_region_t *region = memmap_lookup(address);
+
+    if (region != NULL) {
+        uint32_t offset = address - region->start;
+
+        *avail = region->size - offset;
+        return region->mem + offset;
+    }
+
+    *avail = 0;
+    return NULL;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_region                                       */
+/*                                                             */
+/* Purpose: Enumerate the memory regions                       */
+/*                                                             */
+/***************************************************************/
+uint8_t *mem_region(int i, uint32_t *start, uint32_t *size)
+{
+    if (i < 0 || i >= MEM_NREGIONS)
+        return NULL;
+
+    *start = MEM_REGIONS[i].start;
+    *size = MEM_REGIONS[i].size;
+    return MEM_REGIONS[i].mem;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_heap_base                                    */
+/*                                                             */
+/* Purpose: Address of the first heap byte                     */
+/*                                                             */
+/***************************************************************/
+uint32_t mem_heap_base()
+{
+    mem_region_t *heap = memmap_find("heap");
+
+    return heap != NULL ? heap->start : 0;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_heap_grow                                    */
+/*                                                             */
+/* Purpose: Extend the heap region to size bytes. Its host     */
+/*          memory is reserved up front, so this only moves    */
+/*          the end, to a whole checkpoint page so that        */
+/*          checkpoints can save what is written there         */
+/*                                                             */
+/***************************************************************/
+int mem_heap_grow(uint32_t size)
+{
+    mem_region_t *heap = memmap_find("heap");
+    uint32_t end;
+
+    if (heap == NULL || size > heap->limit)
+        return -1;
+    end = (heap->start + size + CHECKPOINT_PAGE_SIZE - 1) &
+          ~(CHECKPOINT_PAGE_SIZE - 1);
+    size = end - heap->start < heap->limit ? end - heap->start : heap->limit;
+    if (size > heap->size)
+        heap->size = size;
+    return 0;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : help                                            */
+/*                                                             */
+/* Purpose   : Print out a list of commands                    */
+/*                                                             */
+/***************************************************************/
+void help() {                                                    
+  printf("----------------MIPS ISIM Help------------------------\n");
+  printf("go                    - run program to completion     \n");
+  printf("status                - show progress of a running go \n");
+  printf("stop                  - halt a running go (or Ctrl-C) \n");
+  printf("continue              - resume after a stop           \n");
+  printf("break [addr]          - stop before executing addr    \n");
+  printf("watch addr [r|w|rw]   - stop after an access to addr  \n");
+  printf("delete addr           - remove a break/watchpoint     \n");
+  printf("checkpoint [n [mb]]   - checkpoint every n instrs     \n");
+  printf("rstep [k]             - step back k instructions      \n");
+  printf("rcontinue             - run back to a breakpoint      \n");
+  printf("run n                 - execute program for n instrs  \n");
+  printf("mdump low high        - dump memory from low to high  \n");
+  printf("msave low high file   - save memory to a binary file  \n");
+  printf("mdiff low file        - list words changed since msave  \n");
+  printf("rdump                 - dump the register & bus value \n");
+  printf("input reg_num reg_val - set GPR reg_num to reg_val    \n");
+  printf("high value            - set the HI register to value  \n");
+  printf("low value             - set the LO register to value  \n");
+  printf("symbols               - list labels of a .s program   \n");
+  printf("disasm low high       - disassemble memory            \n");
+  printf("mode [name]           - pick the interpreter variant  \n");
+  printf("memmap                - show the memory regions       \n");
+  printf("?                     - display this help menu        \n");
+  printf("quit                  - exit the program              \n\n");
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : cycle                                           */
+/*                                                             */
+/* Purpose   : Execute a cycle                                 */
+/*                                                             */
+/***************************************************************/
+void cycle() {                                                
+
+  INTERPRETER();
+  CURRENT_STATE = NEXT_STATE;
+  INSTRUCTION_COUNT++;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : run_batch                                       */
+/*                                                             */
+/* Purpose   : Execute up to n instructions and return how     */
+/*             many ran. Breakpoints and watchpoints are only  */
+/*             looked at when some are set.                    */
+/*                                                             */
+/***************************************************************/
+int run_batch(int n) {
+  int i;
+  uint32_t pc;
+
+  if (NUM_BREAKPOINTS == 0 && NUM_WATCHPOINTS == 0) {
+    for (i = 0; i < n && RUN_BIT; i++)
+      cycle();
+    STEP_OVER_BREAK = FALSE;
+    return i;
+  }
+
+  for (i = 0; i < n && RUN_BIT; i++) {
+    pc = CURRENT_STATE.PC;
+    if (NUM_BREAKPOINTS != 0 && !STEP_OVER_BREAK && break_at(pc)) {
+      STOP_REASON = STOP_BREAK;
+      break;
+    }
+    STEP_OVER_BREAK = FALSE;
+    cycle();
+    if (WATCH_TRIGGERED) {
+      WATCH_TRIGGERED = FALSE;
+      WATCH_HIT_PC = pc;
+      STOP_REASON = STOP_WATCH;
+      i++;
+      break;
+    }
+  }
+  return i;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : past_deadline                                   */
+/*                                                             */
+/* Purpose   : Check the wall clock against SIM_DEADLINE.      */
+/*                                                             */
+/***************************************************************/
+int past_deadline() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > SIM_DEADLINE.tv_sec ||
+         (now.tv_sec == SIM_DEADLINE.tv_sec &&
+          now.tv_nsec >= SIM_DEADLINE.tv_nsec);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : simulate                                        */
+/*                                                             */
+/* Purpose   : Worker thread body. Runs SIM_LIMIT instructions */
+/*             (or until halted when negative), checking for   */
+/*             stop requests once per batch.                   */
+/*                                                             */
+/***************************************************************/
+void *simulate(void *arg) {
+  int64_t remaining = SIM_LIMIT;
+  int executed, batch;
+
+  STOP_REASON = STOP_NONE;
+  while (RUN_BIT && remaining != 0 && STOP_REASON == STOP_NONE &&
+         !atomic_load_explicit(&STOP_REQUEST, memory_order_relaxed)) {
+    if (SIM_DEADLINE.tv_sec != 0 && past_deadline()) {
+      STOP_REASON = STOP_TIME;
+      break;
+    }
+#ifdef SIM_AOT
+    if (AOT_ENABLED && remaining < 0 && CHECKPOINT_INTERVAL == 0 &&
+        NUM_BREAKPOINTS == 0 && NUM_WATCHPOINTS == 0 &&
+        INTERPRETER == process_instruction) {
+      /* untranslated code is stepped by the interpreter */
+      if (aot_run(AOT_BUDGET) == 0)
+        cycle();
+      atomic_store_explicit(&PUBLISHED_COUNT, INSTRUCTION_COUNT,
+                            memory_order_relaxed);
+      continue;
+    }
+#endif
+    batch = STOP_CHECK_INTERVAL;
+    if (remaining > 0 && remaining < batch)
+      batch = remaining;
+    if (CHECKPOINT_INTERVAL != 0) {
+      /* batches end exactly where checkpoints are due */
+      checkpoint_maybe_take();
+      if (checkpoint_next() - INSTRUCTION_COUNT < (uint64_t)batch)
+        batch = checkpoint_next() - INSTRUCTION_COUNT;
+    }
+    executed = run_batch(batch);
+    if (remaining > 0)
+      remaining -= executed;
+    atomic_store_explicit(&PUBLISHED_COUNT, INSTRUCTION_COUNT,
+                          memory_order_relaxed);
+    /* someone is watching, don't hold program output back */
+    if (INTERACTIVE)
+      syscall_flush();
+  }
+
+  syscall_flush();
+  /* this thread's plugin buffer goes with it */
+  plugin_flush();
+  SYSCALL_DEFER_INPUT = FALSE;
+  if (SYSCALL_INPUT_WAITING) {
+    /* the syscall halted without running, take it back */
+    SYSCALL_INPUT_WAITING = FALSE;
+    RUN_BIT = TRUE;
+    INSTRUCTION_COUNT--;
+    atomic_store_explicit(&PUBLISHED_COUNT, INSTRUCTION_COUNT,
+                          memory_order_relaxed);
+    READS_CONSOLE = TRUE;
+    printf("Program is waiting for console input at PC 0x%08x, "
+           "'go' runs it in the foreground\n\n", CURRENT_STATE.PC);
+  } else if (HEADLESS)
+    ; /* run_headless() reports */
+  else if (RUN_BIT == FALSE)
+    printf("Simulator halted\n\n");
+  else if (STOP_REASON == STOP_BREAK)
+    printf("Breakpoint at PC 0x%08x\n\n", CURRENT_STATE.PC);
+  else if (STOP_REASON == STOP_WATCH)
+    printf("Watchpoint: %s 0x%08x by PC 0x%08x, stopped at PC 0x%08x\n\n",
+           WATCH_HIT_KIND == WATCH_READ ? "read from" : "write to",
+           WATCH_HIT_ADDR, WATCH_HIT_PC, CURRENT_STATE.PC);
+  else if (remaining != 0)
+    printf("Simulator stopped at PC 0x%08x\n\n", CURRENT_STATE.PC);
+  fflush(stdout);
+
+  atomic_store(&SIM_RUNNING, FALSE);
+  return NULL;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : wait_simulation                                 */
+/*                                                             */
+/* Purpose   : Join the worker thread once it has finished.    */
+/*                                                             */
+/***************************************************************/
+void wait_simulation() {
+  if (SIM_JOINABLE) {
+    pthread_join(SIM_THREAD, NULL);
+    SIM_JOINABLE = FALSE;
+  }
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : start_simulation                                */
+/*                                                             */
+/* Purpose   : Run on the worker thread, in the background or  */
+/*             waiting for it to finish.                       */
+/*                                                             */
+/***************************************************************/
+void start_simulation(int64_t num_cycles, int background) {
+  wait_simulation();
+
+  SIM_LIMIT = num_cycles;
+  STEP_OVER_BREAK = TRUE;
+  atomic_store(&STOP_REQUEST, FALSE);
+  atomic_store(&PUBLISHED_COUNT, INSTRUCTION_COUNT);
+  clock_gettime(CLOCK_MONOTONIC, &STATUS_TIME);
+  STATUS_COUNT = INSTRUCTION_COUNT;
+  /* the shell keeps reading stdin, the program must not */
+  SYSCALL_DEFER_INPUT = background;
+
+  atomic_store(&SIM_RUNNING, TRUE);
+  if (pthread_create(&SIM_THREAD, NULL, simulate, NULL) != 0) {
+    atomic_store(&SIM_RUNNING, FALSE);
+    printf("Error: Can't start simulation thread\n\n");
+    return;
+  }
+  SIM_JOINABLE = TRUE;
+
+  if (!background)
+    wait_simulation();
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : is_running                                      */
+/*                                                             */
+/* Purpose   : Refuse commands which need a stopped machine.   */
+/*                                                             */
+/***************************************************************/
+int is_running() {
+  if (atomic_load(&SIM_RUNNING)) {
+    printf("Simulator is running, use 'stop' first\n\n");
+    return TRUE;
+  }
+  wait_simulation();
+  return FALSE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : stop_simulation                                 */
+/*                                                             */
+/* Purpose   : Halt a running simulation at the next batch     */
+/*             boundary and wait for it.                       */
+/*                                                             */
+/***************************************************************/
+void stop_simulation() {
+  if (!atomic_load(&SIM_RUNNING)) {
+    wait_simulation();
+    printf("Simulator is not running\n\n");
+    return;
+  }
+  atomic_store(&STOP_REQUEST, TRUE);
+  wait_simulation();
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : status                                          */
+/*                                                             */
+/* Purpose   : Report progress and the rate since the last     */
+/*             status report.                                  */
+/*                                                             */
+/***************************************************************/
+void status() {
+  struct timespec now;
+  uint64_t count = atomic_load_explicit(&PUBLISHED_COUNT,
+                                        memory_order_relaxed);
+  double elapsed;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = (now.tv_sec - STATUS_TIME.tv_sec) +
+            (now.tv_nsec - STATUS_TIME.tv_nsec) / 1e9;
+
+  if (atomic_load(&SIM_RUNNING)) {
+    printf("Simulator is running\n");
+    printf("Instruction Count : %llu\n", (unsigned long long)count);
+    if (elapsed > 0)
+      printf("Rate              : %.2f MIPS\n",
+             (count - STATUS_COUNT) / elapsed / 1e6);
+  } else {
+    wait_simulation();
+    printf("Simulator is %s\n", RUN_BIT ? "stopped" : "halted");
+    printf("Instruction Count : %llu\n",
+           (unsigned long long)INSTRUCTION_COUNT);
+    printf("PC                : 0x%08x\n", CURRENT_STATE.PC);
+  }
+  printf("\n");
+
+  STATUS_TIME = now;
+  STATUS_COUNT = count;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : handle_sigint                                   */
+/*                                                             */
+/* Purpose   : Ctrl-C stops a running simulation, and exits as */
+/*             before when nothing is running.                 */
+/*                                                             */
+/***************************************************************/
+void handle_sigint(int sig) {
+  if (atomic_load(&SIM_RUNNING)) {
+    atomic_store(&STOP_REQUEST, TRUE);
+    return;
+  }
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : run n                                           */
+/*                                                             */
+/* Purpose   : Simulate MIPS for n cycles                      */
+/*                                                             */
+/***************************************************************/
+void run(int64_t num_cycles) {                                  
+  if (RUN_BIT == FALSE) {
+    printf("Can't simulate, Simulator is halted\n\n");
+    return;
+  }
+
+  printf("Simulating for %lld cycles...\n\n", (long long)num_cycles);
+  if (num_cycles > 0)
+    start_simulation(num_cycles, FALSE);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : go                                              */
+/*                                                             */
+/* Purpose   : Simulate MIPS until HALTed. Interactive shells  */
+/*             get the prompt back while the program runs.     */
+/*                                                             */
+/***************************************************************/
+void go() {                                                     
+  if (RUN_BIT == FALSE) {
+    printf("Can't simulate, Simulator is halted\n\n");
+    return;
+  }
+
+  printf("Simulating...\n\n");
+  start_simulation(-1, INTERACTIVE && !READS_CONSOLE);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : print_mem                                       */
+/*                                                             */
+/* Purpose   : Write a word-aligned region of memory to out.   */
+/*                                                             */
+/***************************************************************/
+#define DUMP_BUFFER 65536
+
+/* hex and decimal formatting for dumps, without printf's overhead */
+char *put_hex(char *p, uint32_t value) {
+  int i;
+  for (i = 7; i >= 0; i--, value >>= 4)
+    p[i] = "0123456789abcdef"[value & 0xf];
+  return p + 8;
+}
+
+char *put_dec(char *p, int32_t value) {
+  char digits[10];
+  uint32_t v = value < 0 ? -(uint32_t)value : (uint32_t)value;
+  int n = 0;
+
+  if (value < 0)
+    *p++ = '-';
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v != 0);
+  while (n > 0)
+    *p++ = digits[--n];
+  return p;
+}
+
+void print_mem(FILE * out, int start, int stop) {
+  static char buf[DUMP_BUFFER];
+  char *p = buf;
+  int64_t address;
+
+  fprintf(out, "\nMemory content [0x%08x..0x%08x] :\n", start, stop);
+  fprintf(out, "-------------------------------------\n");
+  /* same lines as "  0x%08x (%d) : 0x%08x\n", written in large blocks */
+  for (address = start; address <= stop; address += 4) {
+    if (p - buf > DUMP_BUFFER - 64) {
+      fwrite(buf, 1, p - buf, out);
+      p = buf;
+    }
+    memcpy(p, "  0x", 4);
+    p = put_hex(p + 4, address);
+    memcpy(p, " (", 2);
+    p = put_dec(p + 2, address);
+    memcpy(p, ") : 0x", 6);
+    p = put_hex(p + 6, mem_read_32(address));
+    *p++ = '\n';
+  }
+  fwrite(buf, 1, p - buf, out);
+  fprintf(out, "\n");
+}
+
+/***************************************************************/ 
+/*                                                             */
+/* Procedure : mdump                                           */
+/*                                                             */
+/* Purpose   : Dump a word-aligned region of memory to the     */
+/*             output file.                                    */
+/*                                                             */
+/***************************************************************/
+void mdump(FILE * dumpsim_file, int start, int stop) {          
+  print_mem(stdout, start, stop);
+
+  /* dump the memory contents into the dumpsim file */
+  print_mem(dumpsim_file, start, stop);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : save_mem                                        */
+/*                                                             */
+/* Purpose   : Write the words from start to stop to a file as */
+/*             a raw memory image, copied straight from the    */
+/*             regions. Unmapped addresses are saved as 0.     */
+/*                                                             */
+/***************************************************************/
+int save_mem(const char *filename, uint32_t start, uint32_t stop) {
+  static const char zero[DUMP_BUFFER];
+  uint64_t address = start, end = (uint64_t)stop + 4, next;
+  uint32_t avail;
+  uint8_t *mem;
+  FILE *out;
+  int i;
+
+  if ((out = fopen(filename, "wb")) == NULL)
+    return -1;
+  while (address < end) {
+    if ((mem = mem_ptr(address, &avail)) == NULL) {
+      /* zeros up to the next region */
+      next = end;
+      for (i = 0; i < MEM_NREGIONS; i++)
+        if (MEM_REGIONS[i].start > address && MEM_REGIONS[i].start < next)
+          next = MEM_REGIONS[i].start;
+      avail = next - address < DUMP_BUFFER ? next - address : DUMP_BUFFER;
+      mem = (uint8_t *)zero;
+    } else if (avail > end - address)
+      avail = end - address;
+    if (fwrite(mem, 1, avail, out) != avail)
+      break;
+    address += avail;
+  }
+  if (fclose(out) != 0 || address < end)
+    return -1;
+  return 0;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : msave                                           */
+/*                                                             */
+/* Purpose   : Save a word-aligned region of memory in binary. */
+/*                                                             */
+/***************************************************************/
+void msave(int start, int stop, const char *filename) {
+  if ((uint32_t)stop < (uint32_t)start) {
+    printf("Nothing to save\n\n");
+    return;
+  }
+  if (save_mem(filename, start, stop) != 0)
+    printf("Error: Can't write %s\n\n", filename);
+  else
+    printf("Saved 0x%08x..0x%08x to %s\n\n", start, stop, filename);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : mdiff                                           */
+/*                                                             */
+/* Purpose   : Compare memory from start with a file saved by  */
+/*             msave and list the word ranges that changed.    */
+/*                                                             */
+/***************************************************************/
+void mdiff(int start, const char *filename) {
+  static uint8_t buf[DUMP_BUFFER];
+  uint64_t address = (uint32_t)start, first = 0, changed = 0;
+  uint32_t i, n, ranges = 0, word;
+  int in_range = FALSE;
+  FILE *in;
+
+  if ((in = fopen(filename, "rb")) == NULL) {
+    printf("Error: Can't open %s\n\n", filename);
+    return;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in) & ~3u) != 0) {
+    for (i = 0; i < n && address + i < 0x100000000ull; i += 4) {
+      word = buf[i] | (buf[i+1] << 8) | (buf[i+2] << 16) |
+             ((uint32_t)buf[i+3] << 24);
+      if (mem_read_32(address + i) != word) {
+        if (!in_range) {
+          first = address + i;
+          in_range = TRUE;
+        }
+        changed++;
+      } else if (in_range) {
+        printf("  0x%08x..0x%08x  (%llu words)\n", (uint32_t)first,
+               (uint32_t)(address + i - 4),
+               (unsigned long long)(address + i - first) / 4);
+        in_range = FALSE;
+        ranges++;
+      }
+    }
+    address += i;
+    if (i < n)
+      break;
+  }
+  if (in_range) {
+    printf("  0x%08x..0x%08x  (%llu words)\n", (uint32_t)first,
+           (uint32_t)(address - 4),
+           (unsigned long long)(address - first) / 4);
+    ranges++;
+  }
+  fclose(in);
+
+  if (changed == 0)
+    printf("Memory matches %s, %llu words from 0x%08x\n\n", filename,
+           (unsigned long long)(address - (uint32_t)start) / 4, start);
+  else
+    printf("%llu words differ from %s in %u ranges\n\n",
+           (unsigned long long)changed, filename, ranges);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : print_regs                                      */
+/*                                                             */
+/* Purpose   : Write the register and bus values to out.       */
+/*                                                             */
+/***************************************************************/
+void print_regs(FILE * out) {
+  int k;
+
+  fprintf(out, "\nCurrent register/bus values :\n");
+  fprintf(out, "-------------------------------------\n");
+  fprintf(out, "Instruction Count : %llu\n",
+          (unsigned long long)INSTRUCTION_COUNT);
+  fprintf(out, "PC                : 0x%08x\n", CURRENT_STATE.PC);
+  fprintf(out, "Registers:\n");
+  for (k = 0; k < MIPS_REGS; k++)
+    fprintf(out, "R%d: 0x%08x\n", k, CURRENT_STATE.REGS[k]);
+  fprintf(out, "HI: 0x%08x\n", CURRENT_STATE.HI);
+  fprintf(out, "LO: 0x%08x\n", CURRENT_STATE.LO);
+  fprintf(out, "\n");
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : rdump                                           */
+/*                                                             */
+/* Purpose   : Dump current register and bus values to the     */   
+/*             output file.                                    */
+/*                                                             */
+/***************************************************************/
+void rdump(FILE * dumpsim_file) {                               
+  print_regs(stdout);
+
+  /* dump the state information into the dumpsim file */
+  print_regs(dumpsim_file);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : parse_address                                   */
+/*                                                             */
+/* Purpose   : Read a number or a label of the loaded program. */
+/*                                                             */
+/***************************************************************/
+int parse_address(const char *token, uint32_t *address) {
+  const asm_symbol_t *symbol;
+  char *end;
+
+  *address = strtoul(token, &end, 0);
+  if (*token != '\0' && *end == '\0')
+    return TRUE;
+
+  symbol = asm_find_symbol(&PROGRAM_SYMBOLS, token);
+  if (symbol != NULL) {
+    *address = symbol->addr;
+    return TRUE;
+  }
+  printf("Unknown address %s\n\n", token);
+  return FALSE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : debug_command                                   */
+/*                                                             */
+/* Purpose   : break, watch and delete. Arguments are read     */
+/*             from the rest of the command line.              */
+/*                                                             */
+/***************************************************************/
+void debug_command(char command) {
+  char line[128], target[64], mode[8];
+  uint32_t address;
+  int kind, args;
+
+  if (fgets(line, sizeof(line), stdin) == NULL)
+    line[0] = '\0';
+  /* the worker reads the breakpoint and watchpoint tables */
+  if (is_running())
+    return;
+  args = sscanf(line, "%63s %7s", target, mode);
+
+  if (command == 'b' && args < 1) {
+    debug_list(stdout);
+    printf("\n");
+    return;
+  }
+  if (args < 1) {
+    printf("Missing address\n\n");
+    return;
+  }
+  if (!parse_address(target, &address))
+    return;
+
+  switch (command) {
+  case 'b':
+    if (break_insert(address) == 0)
+      printf("Breakpoint at 0x%08x\n\n", address & ~3u);
+    else
+      printf("Breakpoint at 0x%08x already exists\n\n", address & ~3u);
+    break;
+
+  case 'w':
+    kind = WATCH_WRITE;
+    if (args == 2) {
+      if (strcmp(mode, "r") == 0)
+        kind = WATCH_READ;
+      else if (strcmp(mode, "rw") == 0)
+        kind = WATCH_READ | WATCH_WRITE;
+      else if (strcmp(mode, "w") != 0) {
+        printf("Watch mode must be r, w or rw\n\n");
+        return;
+      }
+    }
+    watch_insert(address, kind);
+    printf("Watchpoint at 0x%08x\n\n", address & ~3u);
+    break;
+
+  case 'd':
+    if (break_remove(address) != 0 && watch_remove(address) != 0)
+      printf("Nothing set at 0x%08x\n\n", address);
+    else
+      printf("Deleted 0x%08x\n\n", address & ~3u);
+    break;
+  }
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : replay                                          */
+/*                                                             */
+/* Purpose   : Re-execute up to instruction `count` without    */
+/*             stopping, taking checkpoints on the way. Returns */
+/*             the count at the last breakpoint passed, or -1. */
+/*                                                             */
+/***************************************************************/
+int64_t replay(uint64_t count) {
+  int64_t last_break = -1;
+  uint64_t stop;
+
+  uint32_t plugin_kinds = PLUGIN_KINDS;
+
+  /* the program's output was already printed, and plugins saw it run */
+  SYSCALL_QUIET = TRUE;
+  PLUGIN_KINDS = 0;
+  while (INSTRUCTION_COUNT < count && RUN_BIT) {
+    checkpoint_maybe_take();
+    stop = checkpoint_next() < count ? checkpoint_next() : count;
+    while (INSTRUCTION_COUNT < stop && RUN_BIT) {
+      if (NUM_BREAKPOINTS != 0 && break_at(CURRENT_STATE.PC))
+        last_break = INSTRUCTION_COUNT;
+      cycle();
     }
+  }
+  WATCH_TRIGGERED = FALSE;
+  SYSCALL_QUIET = FALSE;
+  PLUGIN_KINDS = plugin_kinds;
+  return last_break;
 }
 
 /***************************************************************/
 /*                                                             */
-/* Procedure : help                                            */
+/* Procedure : rstep                                           */
 /*                                                             */
-/* Purpose   : Print out a list of commands                    */
+/* Purpose   : Go back k instructions: restore the nearest     */
+/*             checkpoint before and replay the rest.          */
 /*                                                             */
 /***************************************************************/
-void help() {                                                    
-  printf("----------------MIPS ISIM Help------------------------\n");
-  printf("go                    - run program to completion     \n");
-  printf("run n                 - execute program for n instrs  \n");
-  printf("mdump low high        - dump memory from low to high  \n");
-  printf("rdump                 - dump the register & bus value \n");
-  printf("input reg_num reg_val - set GPR reg_num to reg_val    \n");
-  printf("high value            - set the HI register to value  \n");
-  printf("low value             - set the LO register to value  \n");
-  printf("?                     - display this help menu        \n");
-  printf("quit                  - exit the program              \n\n");
+void rstep(uint64_t k) {
+  uint64_t target = 0;
+
+  if (INSTRUCTION_COUNT > k)
+    target = INSTRUCTION_COUNT - k;
+  if (checkpoint_restore(target) != 0) {
+    printf("History only goes back to instruction %llu\n\n",
+           (unsigned long long)checkpoint_oldest());
+    return;
+  }
+  replay(target);
+  printf("Back at instruction %llu, PC 0x%08x\n\n",
+         (unsigned long long)INSTRUCTION_COUNT, CURRENT_STATE.PC);
 }
 
 /***************************************************************/
 /*                                                             */
-/* Procedure : cycle                                           */
+/* Procedure : rcontinue                                       */
 /*                                                             */
-/* Purpose   : Execute a cycle                                 */
+/* Purpose   : Go back to the last breakpoint reached. Each    */
+/*             checkpoint interval is replayed looking for one, */
+/*             newest first.                                   */
 /*                                                             */
 /***************************************************************/
-void cycle() {                                                
+void rcontinue() {
+  uint64_t end = INSTRUCTION_COUNT, start;
+  int64_t hit = -1;
 
-  process_instruction();
-  CURRENT_STATE = NEXT_STATE;
-  INSTRUCTION_COUNT++;
+  if (NUM_BREAKPOINTS == 0) {
+    printf("No breakpoints set\n\n");
+    return;
+  }
+  while (end > 0 && checkpoint_restore(end - 1) == 0) {
+    start = INSTRUCTION_COUNT;
+    hit = replay(end);
+    if (hit >= 0)
+      break;
+    checkpoint_restore(start);
+    end = start;
+  }
+
+  if (hit >= 0) {
+    checkpoint_restore(hit);
+    replay(hit);
+    printf("Breakpoint at PC 0x%08x, instruction %llu\n\n",
+           CURRENT_STATE.PC, (unsigned long long)INSTRUCTION_COUNT);
+  } else
+    printf("No earlier breakpoint, back at instruction %llu, "
+           "PC 0x%08x\n\n", (unsigned long long)INSTRUCTION_COUNT,
+           CURRENT_STATE.PC);
 }
 
 /***************************************************************/
 /*                                                             */
-/* Procedure : run n                                           */
+/* Procedure : reverse_command                                 */
 /*                                                             */
-/* Purpose   : Simulate MIPS for n cycles                      */
+/* Purpose   : checkpoint, rstep and rcontinue. Arguments are  */
+/*             read from the rest of the command line.         */
 /*                                                             */
 /***************************************************************/
-void run(int num_cycles) {                                      
-  int i;
+void reverse_command(char command) {
+  char line[128];
+  unsigned long long interval, steps, megabytes = 64;
+  uint32_t count;
+  uint64_t bytes;
+  int args;
 
-  if (RUN_BIT == FALSE) {
-    printf("Can't simulate, Simulator is halted\n\n");
+  if (fgets(line, sizeof(line), stdin) == NULL)
+    line[0] = '\0';
+  if (is_running())
     return;
-  }
 
-  printf("Simulating for %d cycles...\n\n", num_cycles);
-  for (i = 0; i < num_cycles; i++) {
-    if (RUN_BIT == FALSE) {
-	    printf("Simulator halted\n\n");
-	    break;
+  if (command == 'c') {
+    args = sscanf(line, "%llu %llu", &interval, &megabytes);
+    if (args < 1) {
+      checkpoint_stats(&count, &bytes);
+      if (CHECKPOINT_INTERVAL == 0)
+        printf("Checkpoints are off\n\n");
+      else
+        printf("Every %llu instructions, %u kept back to instruction "
+               "%llu, %llu KB\n\n", (unsigned long long)CHECKPOINT_INTERVAL,
+               count, (unsigned long long)checkpoint_oldest(),
+               (unsigned long long)bytes >> 10);
+      return;
     }
-    cycle();
+    checkpoint_configure(interval, megabytes << 20);
+    if (interval == 0)
+      printf("Checkpoints off\n\n");
+    else
+      printf("Checkpoint every %llu instructions, up to %llu MB\n\n",
+             interval, megabytes);
+    return;
+  }
+
+  if (CHECKPOINT_INTERVAL == 0) {
+    printf("Checkpoints are off, use 'checkpoint n' first\n\n");
+    return;
   }
+  if (command == 's') {
+    if (sscanf(line, "%llu", &steps) != 1)
+      steps = 1;
+    rstep(steps);
+  } else
+    rcontinue();
 }
 
 /***************************************************************/
 /*                                                             */
-/* Procedure : go                                              */
+/* Procedure : disasm                                          */
 /*                                                             */
-/* Purpose   : Simulate MIPS until HALTed                      */
+/* Purpose   : Disassemble memory from start to stop           */
 /*                                                             */
 /***************************************************************/
-void go() {                                                     
-  if (RUN_BIT == FALSE) {
-    printf("Can't simulate, Simulator is halted\n\n");
-    return;
+void disasm(int start, int stop) {
+  char text[64];
+  uint32_t address, inst;
+
+  for (address = start & ~3u; address <= (uint32_t)stop; address += 4) {
+    inst = mem_read_32(address);
+    isa_disasm(inst, address, text, sizeof(text));
+    printf("0x%08x: %08x  %s\n", address, inst, text);
+    if (address == 0xfffffffc)
+      break;
   }
+  printf("\n");
+}
 
-  printf("Simulating...\n\n");
-  while (RUN_BIT)
-    cycle();
-  printf("Simulator halted\n\n");
+/***************************************************************/
+/*                                                             */
+/* Procedure : set_interp_mode                                 */
+/*                                                             */
+/* Purpose   : Select an interpreter variant by name. Returns  */
+/*             -1 if there is none of that name.               */
+/*                                                             */
+/***************************************************************/
+int set_interp_mode(const char *name) {
+  int i;
+
+  for (i = 0; i < NUM_INTERP_MODES; i++) {
+    if (strcmp(name, INTERP_MODES[i].name) == 0) {
+      INTERP_MODE = i;
+      INTERPRETER = INTERP_MODES[i].run;
+      return 0;
+    }
+  }
+  return -1;
 }
 
-/***************************************************************/ 
+/***************************************************************/
 /*                                                             */
-/* Procedure : mdump                                           */
+/* Procedure : mode_command                                    */
 /*                                                             */
-/* Purpose   : Dump a word-aligned region of memory to the     */
-/*             output file.                                    */
+/* Purpose   : Switch interpreter variants. Without a name,    */
+/*             report the current one and what it gathered.    */
 /*                                                             */
 /***************************************************************/
-void mdump(FILE * dumpsim_file, int start, int stop) {          
-  int address;
+void mode_command() {
+  char line[128], name[32];
 
-  printf("\nMemory content [0x%08x..0x%08x] :\n", start, stop);
-  printf("-------------------------------------\n");
-  for (address = start; address <= stop; address += 4)
-    printf("  0x%08x (%d) : 0x%08x\n", address, address, mem_read_32(address));
-  printf("\n");
+  if (fgets(line, sizeof(line), stdin) == NULL)
+    line[0] = '\0';
+  if (is_running())
+    return;
 
-  /* dump the memory contents into the dumpsim file */
-  fprintf(dumpsim_file, "\nMemory content [0x%08x..0x%08x] :\n", start, stop);
-  fprintf(dumpsim_file, "-------------------------------------\n");
-  for (address = start; address <= stop; address += 4)
-    fprintf(dumpsim_file, "  0x%08x (%d) : 0x%08x\n", address, address, mem_read_32(address));
-  fprintf(dumpsim_file, "\n");
+  if (sscanf(line, "%31s", name) != 1) {
+    printf("Interpreter: %s\n", INTERP_MODES[INTERP_MODE].name);
+    isa_report(stdout);
+    printf("\n");
+    return;
+  }
+  if (set_interp_mode(name) == 0) {
+    isa_reset_counters();
+    printf("Interpreter: %s\n\n", name);
+    return;
+  }
+  printf("Unknown mode %s, use plain, trace, stats, timing, plugin or "
+         "coverage\n\n", name);
 }
 
 /***************************************************************/
 /*                                                             */
-/* Procedure : rdump                                           */
+/* Procedure : skip_line                                       */
 /*                                                             */
-/* Purpose   : Dump current register and bus values to the     */   
-/*             output file.                                    */
+/* Purpose   : Drop the rest of a command line, so a program   */
+/*             reading the console starts on the next line.    */
 /*                                                             */
 /***************************************************************/
-void rdump(FILE * dumpsim_file) {                               
-  int k; 
-
-  printf("\nCurrent register/bus values :\n");
-  printf("-------------------------------------\n");
-  printf("Instruction Count : %u\n", INSTRUCTION_COUNT);
-  printf("PC                : 0x%08x\n", CURRENT_STATE.PC);
-  printf("Registers:\n");
-  for (k = 0; k < MIPS_REGS; k++)
-    printf("R%d: 0x%08x\n", k, CURRENT_STATE.REGS[k]);
-  printf("HI: 0x%08x\n", CURRENT_STATE.HI);
-  printf("LO: 0x%08x\n", CURRENT_STATE.LO);
-  printf("\n");
+void skip_line() {
+  int c;
 
-  /* dump the state information into the dumpsim file */
-  fprintf(dumpsim_file, "\nCurrent register/bus values :\n");
-  fprintf(dumpsim_file, "-------------------------------------\n");
-  fprintf(dumpsim_file, "Instruction Count : %u\n", INSTRUCTION_COUNT);
-  fprintf(dumpsim_file, "PC                : 0x%08x\n", CURRENT_STATE.PC);
-  fprintf(dumpsim_file, "Registers:\n");
-  for (k = 0; k < MIPS_REGS; k++)
-    fprintf(dumpsim_file, "R%d: 0x%08x\n", k, CURRENT_STATE.REGS[k]);
-  fprintf(dumpsim_file, "HI: 0x%08x\n", CURRENT_STATE.HI);
-  fprintf(dumpsim_file, "LO: 0x%08x\n", CURRENT_STATE.LO);
-  fprintf(dumpsim_file, "\n");
+  while ((c = getchar()) != EOF && c != '\n')
+    ;
 }
 
 /***************************************************************/
@@ -253,29 +1258,59 @@ void rdump(FILE * dumpsim_file) {
 /*                                                             */
 /***************************************************************/
 void get_command(FILE * dumpsim_file) {                         
-  char buffer[20];
-  int start, stop, cycles;
+  char buffer[20], filename[256];
+  int start, stop;
+  long long cycles;
   int register_no, register_value;
   int hi_reg_value, lo_reg_value;
 
   printf("MIPS-SIM> ");
 
-  if (scanf("%s", buffer) == EOF)
+  if (scanf("%s", buffer) == EOF) {
+      /* let a program started from a script run to completion */
+      wait_simulation();
       exit(0);
+  }
 
   printf("\n");
 
   switch(buffer[0]) {
   case 'G':
   case 'g':
+    skip_line();
+    if (is_running()) break;
     go();
     break;
 
   case 'M':
   case 'm':
+    if (buffer[1] == 'o' || buffer[1] == 'O') {
+      mode_command();
+      break;
+    }
+    if (buffer[1] == 'e' || buffer[1] == 'E') {
+      memmap_print(stdout);
+      break;
+    }
+    if (buffer[1] == 's' || buffer[1] == 'S') {
+      if (scanf("%i %i %255s", &start, &stop, filename) != 3)
+        break;
+      if (is_running()) break;
+      msave(start, stop, filename);
+      break;
+    }
+    if ((buffer[1] == 'd' || buffer[1] == 'D') &&
+        (buffer[2] == 'i' || buffer[2] == 'I')) {
+      if (scanf("%i %255s", &start, filename) != 2)
+        break;
+      if (is_running()) break;
+      mdiff(start, filename);
+      break;
+    }
     if (scanf("%i %i", &start, &stop) != 2)
         break;
 
+    if (is_running()) break;
     mdump(dumpsim_file, start, stop);
     break;
 
@@ -285,41 +1320,112 @@ void get_command(FILE * dumpsim_file) {
 
   case 'Q':
   case 'q':
+    if (atomic_load(&SIM_RUNNING))
+      stop_simulation();
     printf("Bye.\n");
     exit(0);
 
+  case 'S':
+  case 's':
+    if (buffer[1] == 't' && buffer[2] == 'a') {
+      status();
+      break;
+    }
+    if (buffer[1] == 't' && buffer[2] == 'o') {
+      stop_simulation();
+      break;
+    }
+    if (PROGRAM_SYMBOLS.num_symbols == 0)
+      printf("No symbols loaded\n\n");
+    else {
+      asm_write_symbols(&PROGRAM_SYMBOLS, stdout);
+      printf("\n");
+    }
+    break;
+
   case 'R':
   case 'r':
-    if (buffer[1] == 'd' || buffer[1] == 'D')
+    if (buffer[1] == 'd' || buffer[1] == 'D') {
+	    if (is_running()) break;
 	    rdump(dumpsim_file);
-    else {
-	    if (scanf("%d", &cycles) != 1) break;
+    } else if (buffer[1] == 's' || buffer[1] == 'S') {
+	    reverse_command('s');
+    } else if (buffer[1] == 'c' || buffer[1] == 'C') {
+	    reverse_command('r');
+    } else {
+	    if (scanf("%lld", &cycles) != 1) break;
+	    skip_line();
+	    if (is_running()) break;
 	    run(cycles);
     }
     break;
 
+  case 'B':
+  case 'b':
+    debug_command('b');
+    break;
+
+  case 'W':
+  case 'w':
+    debug_command('w');
+    break;
+
+  case 'D':
+  case 'd':
+    if (buffer[1] == 'i' || buffer[1] == 'I') {
+      if (scanf("%i %i", &start, &stop) != 2)
+        break;
+      if (is_running()) break;
+      disasm(start, stop);
+      break;
+    }
+    debug_command('d');
+    break;
+
+  case 'C':
+  case 'c':
+    if (buffer[1] == 'h' || buffer[1] == 'H') {
+      reverse_command('c');
+      break;
+    }
+    skip_line();
+    if (is_running()) break;
+    if (RUN_BIT == FALSE) {
+      printf("Can't simulate, Simulator is halted\n\n");
+      break;
+    }
+    printf("Continuing...\n\n");
+    start_simulation(-1, INTERACTIVE);
+    break;
+
   case 'I':
   case 'i':
    if (scanf("%i %i", &register_no, &register_value) != 2)
       break;
+   if (is_running()) break;
    CURRENT_STATE.REGS[register_no] = register_value;
    NEXT_STATE.REGS[register_no] = register_value;
+   checkpoint_reset();
    break;
   
   case 'H':
   case 'h':
    if (scanf("%i", &hi_reg_value) != 1)
       break;
+   if (is_running()) break;
    CURRENT_STATE.HI = hi_reg_value; 
    NEXT_STATE.HI = hi_reg_value; 
+   checkpoint_reset();
    break;
   
   case 'L':
   case 'l':
    if (scanf("%i", &lo_reg_value) != 1)
       break;
+   if (is_running()) break;
    CURRENT_STATE.LO = lo_reg_value;
    NEXT_STATE.LO = lo_reg_value;
+   checkpoint_reset();
    break;
 
   default:
@@ -336,13 +1442,80 @@ void get_command(FILE * dumpsim_file) {
 /*                                                             */
 /***************************************************************/
 void init_memory() {                                           
-    int i;
-    for (i = 0; i < MEM_NREGIONS; i++) {
-        MEM_REGIONS[i].mem = malloc(MEM_REGIONS[i].size);
-        memset(MEM_REGIONS[i].mem, 0, MEM_REGIONS[i].size);
+    char error[256];
+
+    /* regions are reserved, not allocated; untouched pages stay free */
+    if (memmap_map(error, sizeof(error)) != 0) {
+        printf("Error: memory map: %s\n", error);
+        exit(-1);
     }
 }
 
+/**************************************************************/
+/*                                                            */
+/* Procedure : is_source_file                                 */
+/*                                                            */
+/* Purpose   : Check whether a program file is assembly text. */
+/*                                                            */
+/**************************************************************/
+int is_source_file(const char *filename) {
+  const char *ext = strrchr(filename, '.');
+  return ext != NULL && (strcmp(ext, ".s") == 0 || strcmp(ext, ".asm") == 0);
+}
+
+/**************************************************************/
+/*                                                            */
+/* Procedure : assemble_source                                */
+/*                                                            */
+/* Purpose   : Assemble a .s file into PROGRAM_SYMBOLS at the */
+/*             bases of the text and data regions.            */
+/*                                                            */
+/**************************************************************/
+int assemble_source(const char *filename) {
+  mem_region_t *text = memmap_find("text"), *data = memmap_find("data");
+
+  asm_free(&PROGRAM_SYMBOLS);
+  return asm_assemble_file(&PROGRAM_SYMBOLS, filename,
+                           text != NULL ? text->start : ASM_TEXT_BASE,
+                           data != NULL ? data->start : ASM_DATA_BASE);
+}
+
+/**************************************************************/
+/*                                                            */
+/* Procedure : load_source                                    */
+/*                                                            */
+/* Purpose   : Assemble a .s file and load its text and data  */
+/*             segments into memory.                          */
+/*                                                            */
+/**************************************************************/
+void load_source(char *program_filename) {
+  uint32_t ii, word;
+  int b;
+
+  if (assemble_source(program_filename) != 0) {
+    printf("Error: %s: %s\n", program_filename, PROGRAM_SYMBOLS.error);
+    exit(-1);
+  }
+
+  for (ii = 0; ii < PROGRAM_SYMBOLS.text_len; ii++)
+    mem_write_32(PROGRAM_SYMBOLS.text_base + ii * 4, PROGRAM_SYMBOLS.text[ii]);
+
+  for (ii = 0; ii < PROGRAM_SYMBOLS.data_len; ii += 4) {
+    word = 0;
+    for (b = 0; b < 4 && ii + b < PROGRAM_SYMBOLS.data_len; b++)
+      word |= PROGRAM_SYMBOLS.data[ii + b] << (8 * b);
+    mem_write_32(PROGRAM_SYMBOLS.data_base + ii, word);
+  }
+
+  CURRENT_STATE.PC = PROGRAM_SYMBOLS.text_base;
+  PROGRAM_TEXT_END = PROGRAM_SYMBOLS.text_base + PROGRAM_SYMBOLS.text_len * 4;
+
+  if (!HEADLESS)
+    printf("Assembled %u words of text, %u bytes of data, %u labels.\n\n",
+           PROGRAM_SYMBOLS.text_len, PROGRAM_SYMBOLS.data_len,
+           PROGRAM_SYMBOLS.num_symbols);
+}
+
 /**************************************************************/
 /*                                                            */
 /* Procedure : load_program                                   */
@@ -353,6 +1526,13 @@ void init_memory() {
 void load_program(char *program_filename) {                   
   FILE * prog;
   int ii, word;
+  mem_region_t *text;
+  uint32_t base;
+
+  if (is_source_file(program_filename)) {
+    load_source(program_filename);
+    return;
+  }
 
   /* Open program file. */
   prog = fopen(program_filename, "r");
@@ -363,15 +1543,19 @@ void load_program(char *program_filename) {
 
   /* Read in the program. */
 
+  text = memmap_find("text");
+  base = text != NULL ? text->start : ASM_TEXT_BASE;
   ii = 0;
   while (fscanf(prog, "%x\n", &word) != EOF) {
-    mem_write_32(MEM_TEXT_START + ii, word);
+    mem_write_32(base + ii, word);
     ii += 4;
   }
 
-  CURRENT_STATE.PC = MEM_TEXT_START;
+  CURRENT_STATE.PC = base;
+  PROGRAM_TEXT_END = base + ii;
 
-  printf("Read %d words from program into memory.\n\n", ii/4);
+  if (!HEADLESS)
+    printf("Read %d words from program into memory.\n\n", ii/4);
 }
 
 /************************************************************/
@@ -384,15 +1568,287 @@ void load_program(char *program_filename) {
 /************************************************************/
 void initialize(char *program_filename, int num_prog_files) { 
   int i;
+  mem_region_t *stack;
 
   init_memory();
   for ( i = 0; i < num_prog_files; i++ ) {
     load_program(program_filename);
     while(*program_filename++ != '\0');
   }
+  /* $sp starts at the last word of the stack */
+  if ((stack = memmap_find("stack")) != NULL && stack->size >= 4)
+    CURRENT_STATE.REGS[29] = stack->start + stack->size - 4;
+  if (COVERAGE_PATH != NULL)
+    coverage_start(COVERAGE_PATH, CURRENT_STATE.PC,
+                   (PROGRAM_TEXT_END - CURRENT_STATE.PC) / 4);
   NEXT_STATE = CURRENT_STATE;
     
   RUN_BIT = TRUE;
+  FAULTED = FALSE;
+  READS_CONSOLE = FALSE;
+  syscall_reset();
+
+#ifdef SIM_AOT
+  /* the translation is only valid for the exact text it was made from */
+  AOT_ENABLED = TRUE;
+  for (i = 0; i < AOT_TEXT_WORDS; i++)
+    if (mem_read_32(AOT_TEXT_START + i * 4) != AOT_TEXT[i])
+      AOT_ENABLED = FALSE;
+  if (AOT_ENABLED) {
+    if (!HEADLESS)
+      printf("Using ahead-of-time translation of %u words.\n\n",
+             AOT_TEXT_WORDS);
+  } else
+    fprintf(HEADLESS ? stderr : stdout,
+            "Warning: translation does not match the program, "
+            "interpreting.\n\n");
+#endif
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : write_state                                     */
+/*                                                             */
+/* Purpose   : Write the final state as the regression engine  */
+/*             records it: a "key value" line per register,    */
+/*             the console output and the nonzero words of the */
+/*             given ranges, in address order.                 */
+/*                                                             */
+/***************************************************************/
+void write_state(FILE * out, int code, uint32_t ranges[][2], int num_ranges) {
+  uint64_t address;
+  uint32_t value;
+  int i;
+
+  fprintf(out, "insns %llu\nexit %d\npc 0x%08x\n",
+          (unsigned long long)INSTRUCTION_COUNT, code, CURRENT_STATE.PC);
+  for (i = 0; i < MIPS_REGS; i++)
+    fprintf(out, "r%d 0x%08x\n", i, CURRENT_STATE.REGS[i]);
+  fprintf(out, "hi 0x%08x\nlo 0x%08x\n", CURRENT_STATE.HI, CURRENT_STATE.LO);
+  fprintf(out, "output %llu 0x%016llx\n",
+          (unsigned long long)SYSCALL_OUTPUT_BYTES,
+          (unsigned long long)SYSCALL_OUTPUT_HASH);
+  for (i = 0; i < num_ranges; i++)
+    for (address = ranges[i][0]; address <= ranges[i][1]; address += 4)
+      if ((value = mem_read_32(address)) != 0)
+        fprintf(out, "mem 0x%08x 0x%08x\n", (uint32_t)address, value);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : trace_state                                     */
+/*                                                             */
+/* Purpose   : Step up to limit instructions (no limit when    */
+/*             negative) and write a record per instruction:   */
+/*             its PC and word, and a hash of the words it     */
+/*             stored and of the registers, HI/LO, next PC and */
+/*             output after it. Two engines agree up to the    */
+/*             first record that differs.                      */
+/*                                                             */
+/***************************************************************/
+void trace_state(FILE * out, int64_t limit) {
+  uint32_t record[3];
+  uint64_t hash, stores;
+  int i;
+
+  STOP_REASON = STOP_NONE;
+  STORE_HASH = &stores;
+  while (RUN_BIT && (limit < 0 || INSTRUCTION_COUNT < (uint64_t)limit)) {
+    if (INSTRUCTION_COUNT % STOP_CHECK_INTERVAL == 0 &&
+        SIM_DEADLINE.tv_sec != 0 && past_deadline()) {
+      STOP_REASON = STOP_TIME;
+      break;
+    }
+    record[0] = CURRENT_STATE.PC;
+    record[1] = mem_read_32(record[0]);
+    stores = SYSCALL_HASH_SEED;
+    cycle();
+    hash = (SYSCALL_OUTPUT_HASH ^ stores) * SYSCALL_HASH_PRIME;
+    hash ^= CURRENT_STATE.PC;
+    for (i = 0; i < MIPS_REGS; i++)
+      hash = (hash ^ CURRENT_STATE.REGS[i]) * SYSCALL_HASH_PRIME;
+    hash = (hash ^ CURRENT_STATE.HI) * SYSCALL_HASH_PRIME;
+    hash = (hash ^ CURRENT_STATE.LO) * SYSCALL_HASH_PRIME;
+    record[2] = (uint32_t)(hash ^ (hash >> 32));
+    if (fwrite(record, sizeof(uint32_t), 3, out) != 3)
+      break;
+  }
+  STORE_HASH = NULL;
+  syscall_flush();
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : run_headless                                    */
+/*                                                             */
+/* Purpose   : Run without the shell for batch jobs: to halt   */
+/*             or a limit, then print the requested dumps and  */
+/*             a summary on stderr. Returns the exit status:   */
+/*             the program's exit code when it halts, or one   */
+/*             of the EXIT_* codes when a limit stops it.      */
+/*                                                             */
+/***************************************************************/
+#define MAX_DUMP_RANGES 16
+
+int run_headless(int argc, char *argv[]) {
+  int64_t max_insns = -1;
+  double max_seconds = 0, elapsed;
+  int dump_regs = FALSE, num_ranges = 0, i, code;
+  uint32_t ranges[MAX_DUMP_RANGES][2], state_ranges[MAX_DUMP_RANGES][2];
+  int num_state_ranges = 0;
+  char *save_files[MAX_DUMP_RANGES];
+  char *state_file = NULL, *trace_file = NULL;
+  struct timespec start, end;
+  const char *how;
+  char *end_ptr;
+  FILE *out;
+
+  for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+    if (strcmp(argv[i], "--dump-regs") == 0) {
+      dump_regs = TRUE;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Error: %s needs a value\n", argv[i]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--max-insns") == 0) {
+      max_insns = strtoll(argv[++i], &end_ptr, 0);
+      if (*end_ptr != '\0' || max_insns < 0) {
+        fprintf(stderr, "Error: bad instruction count %s\n", argv[i]);
+        return 2;
+      }
+      /* 0 is no limit */
+      if (max_insns == 0)
+        max_insns = -1;
+    } else if (strcmp(argv[i], "--max-seconds") == 0) {
+      max_seconds = strtod(argv[++i], &end_ptr);
+      if (*end_ptr != '\0' || max_seconds < 0) {
+        fprintf(stderr, "Error: bad time limit %s\n", argv[i]);
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--state") == 0) {
+      state_file = argv[++i];
+    } else if (strcmp(argv[i], "--trace-state") == 0) {
+      trace_file = argv[++i];
+    } else if (strcmp(argv[i], "--state-mem") == 0) {
+      if (num_state_ranges == MAX_DUMP_RANGES) {
+        fprintf(stderr, "Error: at most %d memory ranges\n",
+                MAX_DUMP_RANGES);
+        return 2;
+      }
+      state_ranges[num_state_ranges][0] = strtoul(argv[++i], &end_ptr, 0);
+      if (*end_ptr == ':')
+        state_ranges[num_state_ranges][1] = strtoul(end_ptr + 1, &end_ptr, 0);
+      else
+        end_ptr = "-"; /* not a range */
+      if (*end_ptr != '\0') {
+        fprintf(stderr, "Error: expected --state-mem lo:hi, got %s\n",
+                argv[i]);
+        return 2;
+      }
+      num_state_ranges++;
+    } else if (strcmp(argv[i], "--dump-mem") == 0 ||
+               strcmp(argv[i], "--save-mem") == 0) {
+      /* --save-mem lo:hi:file writes the range in binary instead */
+      int save = argv[i][2] == 's';
+
+      if (num_ranges == MAX_DUMP_RANGES) {
+        fprintf(stderr, "Error: at most %d memory ranges\n",
+                MAX_DUMP_RANGES);
+        return 2;
+      }
+      ranges[num_ranges][0] = strtoul(argv[i + 1], &end_ptr, 0);
+      if (*end_ptr == ':')
+        ranges[num_ranges][1] = strtoul(end_ptr + 1, &end_ptr, 0);
+      else
+        end_ptr = "-"; /* not a range */
+      save_files[num_ranges] = NULL;
+      if (save && *end_ptr == ':' && end_ptr[1] != '\0')
+        save_files[num_ranges] = end_ptr + 1;
+      else if (save || *end_ptr != '\0') {
+        fprintf(stderr, "Error: expected %s lo:hi%s, got %s\n", argv[i],
+                save ? ":file" : "", argv[i + 1]);
+        return 2;
+      }
+      i++;
+      num_ranges++;
+    } else {
+      fprintf(stderr, "Error: unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (i == argc) {
+    fprintf(stderr, "Error: no program to run\n");
+    return 2;
+  }
+
+  HEADLESS = TRUE;
+  initialize(argv[i], argc - i);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (max_seconds > 0) {
+    SIM_DEADLINE.tv_sec = start.tv_sec + (time_t)max_seconds;
+    SIM_DEADLINE.tv_nsec = start.tv_nsec +
+                           (long)((max_seconds - (time_t)max_seconds) * 1e9);
+    if (SIM_DEADLINE.tv_nsec >= 1000000000) {
+      SIM_DEADLINE.tv_sec++;
+      SIM_DEADLINE.tv_nsec -= 1000000000;
+    }
+  }
+  if (trace_file != NULL) {
+    /* one record per instruction, so no batches or translated code */
+    if ((out = fopen(trace_file, "wb")) == NULL) {
+      fprintf(stderr, "Error: Can't open %s\n", trace_file);
+      return 2;
+    }
+    trace_state(out, max_insns);
+    fclose(out);
+  } else
+    start_simulation(max_insns, FALSE);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  if (RUN_BIT == FALSE && FAULTED) {
+    how = "fault";
+    code = EXIT_FAULT;
+  } else if (RUN_BIT == FALSE) {
+    how = "halted";
+    code = SYSCALL_EXIT_CODE & 0xff;
+  } else if (STOP_REASON == STOP_TIME) {
+    how = "time limit";
+    code = EXIT_TIME_LIMIT;
+  } else if (max_insns >= 0 && INSTRUCTION_COUNT >= (uint64_t)max_insns) {
+    how = "instruction limit";
+    code = EXIT_INSN_LIMIT;
+  } else {
+    how = "stopped";
+    code = EXIT_STOPPED;
+  }
+
+  if (dump_regs)
+    print_regs(stdout);
+  for (i = 0; i < num_ranges; i++) {
+    if (save_files[i] == NULL)
+      print_mem(stdout, ranges[i][0], ranges[i][1]);
+    else if (save_mem(save_files[i], ranges[i][0], ranges[i][1]) != 0)
+      fprintf(stderr, "Error: Can't write %s\n", save_files[i]);
+  }
+  fflush(stdout);
+  if (state_file != NULL) {
+    if ((out = fopen(state_file, "w")) == NULL) {
+      fprintf(stderr, "Error: Can't open %s\n", state_file);
+      return 2;
+    }
+    write_state(out, code, state_ranges, num_state_ranges);
+    fclose(out);
+  }
+
+  fprintf(stderr, "%s: %llu instructions in %.3f s, %.2f MIPS, PC 0x%08x, "
+          "exit %d\n", how, (unsigned long long)INSTRUCTION_COUNT, elapsed,
+          elapsed > 0 ? INSTRUCTION_COUNT / elapsed / 1e6 : 0.0,
+          CURRENT_STATE.PC, code);
+  return code;
 }
 
 /***************************************************************/
@@ -402,16 +1858,231 @@ void initialize(char *program_filename, int num_prog_files) {
 /***************************************************************/
 int main(int argc, char *argv[]) {                              
   FILE * dumpsim_file;
+  const char *interp_option = NULL;	/* the option that chose INTERPRETER */
+  const char *setup_option = NULL;	/* the last option other than --interp */
+
+  isa_init();
+
+  /* Memory map, plugin, coverage and interpreter options come first
+   * and apply to every mode */
+  while (argc >= 3 && (strcmp(argv[1], "--mem") == 0 ||
+                       strcmp(argv[1], "--memmap") == 0 ||
+                       strcmp(argv[1], "--plugin") == 0 ||
+                       strcmp(argv[1], "--coverage") == 0 ||
+                       strcmp(argv[1], "--interp") == 0)) {
+    char error[256];
+    void (*chosen)(void) = INTERPRETER;
+
+    if (strcmp(argv[1], "--interp") == 0) {
+      if (set_interp_mode(argv[2]) != 0) {
+        fprintf(stderr, "Error: unknown interpreter %s\n", argv[2]);
+        exit(1);
+      }
+    } else if (strcmp(argv[1], "--coverage") == 0) {
+      if (COVERAGE_PATH != NULL) {
+        fprintf(stderr, "Error: --coverage given twice\n");
+        exit(1);
+      }
+      COVERAGE_PATH = argv[2];
+      INTERPRETER = process_instruction_coverage;
+      for (INTERP_MODE = 0; INTERP_MODES[INTERP_MODE].run != INTERPRETER;)
+        INTERP_MODE++;
+    } else if (strcmp(argv[1], "--plugin") == 0) {
+      if (plugin_load(argv[2]) != 0)
+        exit(1);
+      /* only the plugin interpreter produces events */
+      INTERPRETER = process_instruction_plugin;
+      for (INTERP_MODE = 0; INTERP_MODES[INTERP_MODE].run != INTERPRETER;)
+        INTERP_MODE++;
+    } else if ((argv[1][5] == '\0'
+                    ? memmap_set(argv[2], error, sizeof(error))
+                    : memmap_load(argv[2], error, sizeof(error))) != 0) {
+      fprintf(stderr, "Error: %s\n", error);
+      exit(1);
+    }
+    if (strcmp(argv[1], "--interp") != 0)
+      setup_option = argv[1];
+    /* each of these runs its own interpreter; they don't compose */
+    if (strncmp(argv[1], "--mem", 5) != 0) {
+      if (interp_option != NULL && INTERPRETER != chosen) {
+        fprintf(stderr, "Error: %s %s conflicts with %s\n", argv[1], argv[2],
+                interp_option);
+        exit(1);
+      }
+      interp_option = argv[1];
+    }
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+
+  /* Assemble only: write the text segment as a .x file */
+  if (argc >= 3 && strcmp(argv[1], "--asm") == 0) {
+    FILE *out = stdout;
+
+    if (assemble_source(argv[2]) != 0) {
+      fprintf(stderr, "Error: %s: %s\n", argv[2], PROGRAM_SYMBOLS.error);
+      exit(1);
+    }
+    if (argc >= 4 && (out = fopen(argv[3], "w")) == NULL) {
+      fprintf(stderr, "Error: Can't open %s\n", argv[3]);
+      exit(1);
+    }
+    asm_write_hex(&PROGRAM_SYMBOLS, out);
+    if (out != stdout) {
+      fclose(out);
+      asm_write_symbols(&PROGRAM_SYMBOLS, stdout);
+    }
+    exit(0);
+  }
+
+  /* Translate a program to C for the sim-aot build */
+  if (argc >= 4 && strcmp(argv[1], "--aot") == 0) {
+    FILE *out;
+    int blocks;
+
+    init_memory();
+    load_program(argv[2]);
+    if ((out = fopen(argv[3], "w")) == NULL) {
+      printf("Error: Can't open %s\n", argv[3]);
+      exit(1);
+    }
+    blocks = aot_translate(out, CURRENT_STATE.PC, PROGRAM_TEXT_END);
+    fclose(out);
+    printf("Translated %d basic blocks into %s.\n", blocks, argv[3]);
+    exit(0);
+  }
+
+  /* Merge coverage files of many runs into one */
+  if (argc >= 4 && strcmp(argv[1], "--cov-merge") == 0) {
+    coverage_t merged;
+    int i;
+
+    memset(&merged, 0, sizeof(merged));
+    for (i = 3; i < argc; i++)
+      if (coverage_load(&merged, argv[i]) != 0)
+        exit(1);
+    if (coverage_save(&merged, argv[2]) != 0) {
+      fprintf(stderr, "Error: Can't write %s\n", argv[2]);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  /* Map coverage back to the lines of a .s file, as an lcov tracefile */
+  if (argc >= 4 && strcmp(argv[1], "--cov-report") == 0) {
+    coverage_t cov;
+    FILE *out = stdout;
+
+    memset(&cov, 0, sizeof(cov));
+    if (coverage_load(&cov, argv[2]) != 0)
+      exit(1);
+    if (assemble_source(argv[3]) != 0) {
+      fprintf(stderr, "Error: %s: %s\n", argv[3], PROGRAM_SYMBOLS.error);
+      exit(1);
+    }
+    if (argc >= 5 && (out = fopen(argv[4], "w")) == NULL) {
+      fprintf(stderr, "Error: Can't open %s\n", argv[4]);
+      exit(1);
+    }
+    if (coverage_report(&cov, &PROGRAM_SYMBOLS, argv[3], out) != 0) {
+      fprintf(stderr, "Error: %s is not coverage of %s\n", argv[2],
+              argv[3]);
+      exit(1);
+    }
+    if (out != stdout)
+      fclose(out);
+    exit(0);
+  }
+
+  /* Check every program against its recorded final state */
+  if (argc >= 2 && strcmp(argv[1], "--regress") == 0) {
+    /* the children run the default memory map, which the golden files
+     * were recorded with, and no plugin; coverage goes to a file per
+     * program, see regress.h */
+    if (setup_option != NULL && strcmp(setup_option, "--coverage") == 0) {
+      fprintf(stderr, "Error: use --regress --coverage, which writes a "
+              "<stem>.cov per program\n");
+      exit(2);
+    } else if (setup_option != NULL) {
+      fprintf(stderr, "Error: %s can't be used with --regress\n",
+              setup_option);
+      exit(2);
+    }
+    exit(regress_main(argc - 1, argv + 1, INTERP_MODES[INTERP_MODE].name));
+  }
+
+  /* Run copies of one program side by side, lane i with $a0 = i */
+  if (argc >= 4 && strcmp(argv[1], "--lockstep") == 0) {
+    int lanes = atoi(argv[2]);
+
+    if (lanes < 1 || lanes > LOCKSTEP_MAX_LANES) {
+      printf("Error: lanes must be 1 to %d\n", LOCKSTEP_MAX_LANES);
+      exit(1);
+    }
+    initialize(argv[3], 1);
+    dumpsim_file = fopen("dumpsim", "w");
+    lockstep_run(lanes, argc >= 5 ? strtoull(argv[4], NULL, 0) : 0, stdout,
+                 dumpsim_file);
+    if (dumpsim_file != NULL)
+      fclose(dumpsim_file);
+    exit(0);
+  }
+
+  /* Run without the shell, for batch jobs */
+  if (argc >= 2 && strncmp(argv[1], "--", 2) == 0 &&
+      strcmp(argv[1], "--asm") != 0 && strcmp(argv[1], "--aot") != 0 &&
+      strcmp(argv[1], "--lockstep") != 0 &&
+      strcmp(argv[1], "--cov-merge") != 0 &&
+      strcmp(argv[1], "--cov-report") != 0 &&
+      strcmp(argv[1], "--regress") != 0) {
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_sigint;
+    sigaction(SIGINT, &action, NULL);
+    exit(run_headless(argc, argv));
+  }
 
   /* Error Checking */
   if (argc < 2) {
-    printf("Error: usage: %s <program_file_1> <program_file_2> ...\n",
+    printf("Error: usage: %s [<memory options>] <program_file_1> "
+           "<program_file_2> ...\n", argv[0]);
+    printf("       %s --asm <source.s> [<program.x>]\n", argv[0]);
+    printf("       %s --aot <program> <translation.c>\n", argv[0]);
+    printf("       %s --lockstep <lanes> <program> [<max steps>]\n",
+           argv[0]);
+    printf("       %s [--max-insns <n>] [--max-seconds <s>] [--dump-regs] "
+           "[--dump-mem <lo>:<hi>]\n"
+           "           [--save-mem <lo>:<hi>:<file>] [--state <file>] "
+           "[--state-mem <lo>:<hi>]\n"
+           "           [--trace-state <file>] <program_file> ...\n",
            argv[0]);
+    printf("Memory options: --mem <name>=<start>:<size>[:<perms>], "
+           "--memmap <file>\n");
+    printf("       %s --cov-merge <out.cov> <in.cov> ...\n", argv[0]);
+    printf("       %s --cov-report <file.cov> <source.s> [<out.info>]\n",
+           argv[0]);
+    printf("       %s --regress [--record | --coverage] [-j <n>] "
+           "[--max-insns <n>] [--range <lo>:<hi>] <dir|program> ...\n",
+           argv[0]);
+    printf("Plugins: --plugin <file.so>[=<args>], before the rest\n");
+    printf("Coverage: --coverage <file.cov>, before the rest\n");
+    printf("Interpreter: --interp <mode>, before the rest\n");
     exit(1);
   }
 
   printf("MIPS Simulator\n\n");
 
+  INTERACTIVE = isatty(STDIN_FILENO);
+  {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_sigint;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, NULL);
+  }
+
   initialize(argv[1], argc - 1);
 
   if ( (dumpsim_file = fopen( "dumpsim", "w" )) == NULL ) {
@@ -32,11 +32,45 @@ typedef struct CPU_State_Struct {
 extern CPU_State CURRENT_STATE, NEXT_STATE;
 
 extern int RUN_BIT;	/* run bit */
+extern int FAULTED;	/* RUN_BIT was cleared by a fault, not an exit */
+extern uint64_t INSTRUCTION_COUNT;
 
 uint32_t mem_read_32(uint32_t address);
 void     mem_write_32(uint32_t address, uint32_t value);
 
+/* when not NULL, mem_write_32 folds each address and value into it */
+extern uint64_t *STORE_HASH;
+
+/* host pointer to address and the bytes left in its region, or NULL */
+uint8_t *mem_ptr(uint32_t address, uint32_t *avail);
+
+/* report a guest access the memory map forbids and stop */
+void     mem_fault(uint32_t address, int access);
+
+/* report an instruction word that can't be decoded and stop */
+void     insn_fault(uint32_t inst, uint32_t pc);
+
+/* report a division by zero, or of INT_MIN by -1, and stop */
+void     div_fault(uint32_t pc);
+
+/* the i-th memory region, NULL past the last one */
+uint8_t *mem_region(int i, uint32_t *start, uint32_t *size);
+
+/* the heap region used by sbrk: its base, and growing it to size bytes
+ * (returns -1 when that does not fit below the stack) */
+uint32_t mem_heap_base();
+int      mem_heap_grow(uint32_t size);
+
 /* YOU IMPLEMENT THIS FUNCTION */
 void process_instruction();
 
+/* variants of process_instruction with tracing, per-instruction counts
+ * or cycle accounting, see isa.h, and ones feeding plugins and coverage,
+ * see plugin.h and coverage.h */
+void process_instruction_traced();
+void process_instruction_stats();
+void process_instruction_timing();
+void process_instruction_plugin();
+void process_instruction_coverage();
+
 #endif
@@ -1,6 +1,13 @@
 #include <stdio.h>
 
 #include "shell.h"
+#include "debug.h"
+#include "decode.h"
+#include "coverage.h"
+#include "isa.h"
+#include "memmap.h"
+#include "plugin.h"
+#include "syscall.h"
 
 uint32_t extract_op(uint32_t inst) { return inst >> 26; }
 
@@ -44,485 +51,99 @@ uint32_t zero_ext_byte(uint8_t imm) { return imm; }
 
 uint32_t zero_ext_half(uint16_t imm) { return imm; }
 
-void process_instruction() {
-    /* execute one instruction here. You should use CURRENT_STATE and modify
-     * values in NEXT_STATE. You can call mem_read_32() and mem_write_32() to
-     * access memory. */
-    uint32_t inst = mem_read_32(CURRENT_STATE.PC);
-
-    printf("Instruction: 0x%08x\n", inst);
-
-    uint32_t op = extract_op(inst);
-    uint32_t rs = extract_rs(inst);
-    uint32_t rt = extract_rt(inst);
-    uint32_t imm = extract_imm(inst);
-    uint32_t rd = extract_rd(inst);
-    uint32_t shamt = extract_shamt(inst);
-    uint32_t funct = extract_funct(inst);
-
-    switch (op) {
-        case 0x0: {
-            switch (funct) {
-                case 0x0: {
-                    // SLL
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] << shamt;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x2: {
-                    // SRL
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] >> shamt;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x3: {
-                    // SRA
-                    int32_t val = *((int32_t*)&CURRENT_STATE.REGS[rt]);
-                    val = val >> shamt;
-                    NEXT_STATE.REGS[rd] = val;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x4: {
-                    // SLLV
-                    uint32_t shamt = CURRENT_STATE.REGS[rs] & 0x1f;
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] << shamt;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x6: {
-                    // SRLV
-                    uint32_t shamt = CURRENT_STATE.REGS[rs] & 0x1f;
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] >> shamt;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x7: {
-                    // SRAV
-                    int32_t val = *((int32_t*)&CURRENT_STATE.REGS[rt]);
-                    uint32_t shamt = CURRENT_STATE.REGS[rs] & 0x1f;
-                    val = val >> shamt;
-                    NEXT_STATE.REGS[rd] = val;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x8: {
-                    // JR
-                    NEXT_STATE.PC = CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                case 0x9: {
-                    // JALR
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.PC + 4;
-                    NEXT_STATE.PC = CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                case 0xc: {
-                    // SYSCALL
-                    if (CURRENT_STATE.REGS[2] == 0x0a) {
-                        RUN_BIT = FALSE;
-                    } else {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    }
-                    break;
-                }
-                case 0x10: {
-                    // MFHI
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.HI;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x11: {
-                    // MTHI
-                    NEXT_STATE.HI = CURRENT_STATE.REGS[rs];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x12: {
-                    // MFLO
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.LO;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x13: {
-                    // MTLO
-                    NEXT_STATE.LO = CURRENT_STATE.REGS[rs];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x18: {
-                    // MULT
-                    int64_t lhs = *((int32_t*)&CURRENT_STATE.REGS[rs]);
-                    int64_t rhs = *((int32_t*)&CURRENT_STATE.REGS[rt]);
-                    int64_t product = lhs * rhs;
-                    uint64_t uint_product = *((uint32_t*)&product);
-                    NEXT_STATE.HI =
-                        (uint32_t)((uint_product >> 32) & 0xffffffff);
-                    NEXT_STATE.LO = (uint32_t)(uint_product & 0xffffffff);
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x19: {
-                    // MULTH
-                    uint64_t lhs = CURRENT_STATE.REGS[rs];
-                    uint64_t rhs = CURRENT_STATE.REGS[rt];
-                    uint64_t product = lhs * rhs;
-
-                    NEXT_STATE.HI = (uint32_t)((product >> 32) & 0xffffffff);
-                    NEXT_STATE.LO = (uint32_t)(product & 0xffffffff);
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x1a: {
-                    // DIV
-                    int32_t lhs = *((int32_t*)&CURRENT_STATE.REGS[rs]);
-                    int32_t rhs = *((int32_t*)&CURRENT_STATE.REGS[rt]);
-                    NEXT_STATE.LO = lhs / rhs;
-                    NEXT_STATE.HI = lhs % rhs;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x1b: {
-                    // DIVU
-                    uint32_t lhs = CURRENT_STATE.REGS[rs];
-                    uint32_t rhs = CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.LO = lhs / rhs;
-                    NEXT_STATE.HI = lhs % rhs;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x20: {
-                    // ADD
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] + CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x21: {
-                    // ADDU
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] + CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x22: {
-                    // SUB
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x23: {
-                    // SUBU
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x24: {
-                    // AND
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] & CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x25: {
-                    // OR
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] | CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x26: {
-                    // XOR
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] ^ CURRENT_STATE.REGS[rt];
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x27: {
-                    // NOR
-                    NEXT_STATE.REGS[rd] =
-                        ~(CURRENT_STATE.REGS[rs] | CURRENT_STATE.REGS[rt]);
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x2a: {
-                    // SLT
-                    int32_t lhs = *((int32_t*)&CURRENT_STATE.REGS[rs]);
-                    int32_t rhs = *((int32_t*)&CURRENT_STATE.REGS[rt]);
-                    NEXT_STATE.REGS[rd] = (lhs < rhs) ? 1 : 0;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                case 0x2b: {
-                    // SLTU
-                    NEXT_STATE.REGS[rd] =
-                        CURRENT_STATE.REGS[rs] < CURRENT_STATE.REGS[rt] ? 1 : 0;
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    break;
-                }
-                default: {
-                    printf("Unknown instruction: 0x%x\n", inst);
-                    break;
-                }
-            }
-            break;
-        }
-        case 0x8: {
-            // ADDI
-            NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] + sign_ext(imm);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x9: {
-            // ADDIU
-            NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] + sign_ext(imm);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0xc: {
-            // ANDI
-            NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] & zero_ext(imm);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0xd: {
-            // ORI
-            NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] | zero_ext(imm);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0xe: {
-            // XORI
-            NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] ^ zero_ext(imm);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x4: {
-            // BEQ
-
-            uint32_t offset = sign_ext(imm) << 2;
-
-            if (CURRENT_STATE.REGS[rs] == CURRENT_STATE.REGS[rt]) {
-                NEXT_STATE.PC = CURRENT_STATE.PC + offset + 4;
-            } else {
-                NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            }
-            break;
-        }
-        case 0x1: {
-            uint32_t offset = sign_ext(imm) << 2;
-
-            switch (rt) {
-                case 0x0: {
-                    // BLTZ
-                    if ((CURRENT_STATE.REGS[rs] & 0x80000000) != 0) {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + offset + 4;
-                    } else {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    }
-                    break;
-                }
-                case 0x10: {
-                    // BLTZAL
-                    NEXT_STATE.REGS[31] = CURRENT_STATE.PC + 4;
-                    if ((CURRENT_STATE.REGS[rs] & 0x80000000) != 0) {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + offset + 4;
-                    } else {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    }
-                    break;
-                }
-                case 0x1: {
-                    // BGEZ
-                    if ((CURRENT_STATE.REGS[rs] & 0x80000000) == 0) {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + offset + 4;
-                    } else {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    }
-                    break;
-                }
-                case 0x11: {
-                    // BGEZAL
-                    NEXT_STATE.REGS[31] = CURRENT_STATE.PC + 4;
-                    if ((CURRENT_STATE.REGS[rs] & 0x80000000) == 0) {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + offset + 4;
-                    } else {
-                        NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                    }
-                    break;
-                }
-            }
-            break;
-        }
-        case 0x5: {
-            // BNE
-
-            uint32_t offset = sign_ext(imm) << 2;
-
-            printf("BNE: offset: %d, rs: %d, rt: %d\n", offset, rs, rt);
-
-            printf("rs: 0x%08x\n", CURRENT_STATE.REGS[rs]);
-            printf("rt: 0x%08x\n", CURRENT_STATE.REGS[rt]);
-
-            if (CURRENT_STATE.REGS[rs] != CURRENT_STATE.REGS[rt]) {
-                NEXT_STATE.PC = CURRENT_STATE.PC + offset + 4;
-            } else {
-                NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            }
-            break;
-        }
-        case 0x6: {
-            // BLEZ
-
-            uint32_t offset = sign_ext(imm) << 2;
-
-            if (rt == 0) {
-                if ((CURRENT_STATE.REGS[rs] & 0x80000000) != 0 ||
-                    CURRENT_STATE.REGS[rs] == 0) {
-                    NEXT_STATE.PC = CURRENT_STATE.PC + offset + 4;
-                } else {
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                }
-            } else {
-                // Illegal instruction
-                printf("Illegal rt in BLEZ.\n");
-            }
-            break;
-        }
-        case 0x7: {
-            // BGTZ
-            uint32_t offset = sign_ext(imm) << 2;
-
-            printf("BGTZ: offset: 0x%08x, rs: %d, rt: %d, pc: 0x%08x\n", offset,
-                   rs, rt, CURRENT_STATE.PC);
-
-            if (rt == 0) {
-                if ((CURRENT_STATE.REGS[rs] & 0x80000000) == 0 &&
-                    CURRENT_STATE.REGS[rs] != 0) {
-                    NEXT_STATE.PC = CURRENT_STATE.PC + offset + (uint32_t)4;
-                    printf("PC: 0x%08x\n", NEXT_STATE.PC);
-                } else {
-                    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-                }
-            } else {
-                // Illegal instruction
-                printf("Illegal rt in BGTZ.\n");
-            }
-            break;
-        }
-        case 0x2: {
-            // J
-            uint32_t target = extract_target(inst);
-            NEXT_STATE.PC = (CURRENT_STATE.PC & 0xf0000000) | (target << 2);
-            break;
-        }
-        case 0x3: {
-            // JAL
-            uint32_t target = extract_target(inst);
-            NEXT_STATE.REGS[31] = CURRENT_STATE.PC + 4;
-            NEXT_STATE.PC = (CURRENT_STATE.PC & 0xf0000000) | (target << 2);
-            break;
-        }
-        case 0xf: {
-            // LUI
-
-            if (rs == 0) {
-                NEXT_STATE.REGS[rt] = imm << 16;
-                NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            } else {
-                // Illegal instruction
-            }
-            break;
-        }
-        case 0x20: {
-            // LB
-
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
-
-            uint8_t byte = mem_read_32(addr) & 0xff;
-
-            NEXT_STATE.REGS[rt] = sign_ext_byte(byte);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x24: {
-            // LBU
-
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
-
-            uint8_t byte = mem_read_32(addr) & 0xff;
-
-            NEXT_STATE.REGS[rt] = zero_ext_byte(byte);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x21: {
-            // LH
+static void trace(uint32_t inst, uint32_t pc) {
+    char text[64];
+    isa_disasm(inst, pc, text, sizeof(text));
+    fprintf(ISA_TRACE_FILE ? ISA_TRACE_FILE : stdout, "%08x: %08x  %s\n", pc,
+            inst, text);
+}
 
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
+/// Memory accesses of the generated interpreters. Byte and halfword stores
+/// rewrite the whole word around them.
+static inline uint32_t load(uint32_t addr, uint32_t size) {
+    mem_region_t *region = memmap_lookup(addr);
 
-            uint16_t half = mem_read_32(addr) & 0xffff;
+    WATCH_ACCESS(addr, size, WATCH_READ);
+    if (region != NULL && !(region->perms & MEM_READ)) {
+        mem_fault(addr, MEM_READ);
+        return 0;
+    }
+    return mem_read_32(addr);
+}
 
-            NEXT_STATE.REGS[rt] = sign_ext_half(half);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x25: {
-            // LHU
+static inline void store(uint32_t addr, uint32_t size, uint32_t value) {
+    mem_region_t *region = memmap_lookup(addr);
 
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
+    WATCH_ACCESS(addr, size, WATCH_WRITE);
+    if (region != NULL && !(region->perms & MEM_WRITE)) {
+        mem_fault(addr, MEM_WRITE);
+        return;
+    }
+    if (size == 1) {
+        value = (mem_read_32(addr) & 0xffffff00) | (value & 0xff);
+    } else if (size == 2) {
+        value = (mem_read_32(addr) & 0xffff0000) | (value & 0xffff);
+    }
+    mem_write_32(addr, value);
+}
 
-            uint16_t half = mem_read_32(addr) & 0xffff;
+/* The interpreters, all generated from isa.def. process_instruction() is
+ * the plain one, the others add their instrumentation before each
+ * instruction. */
 
-            NEXT_STATE.REGS[rt] = zero_ext_half(half);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x23: {
-            // LW
+#define INTERP_NAME process_instruction
+#define INTERP_BEFORE(id, inst, pc)
+#include "interp.def"
 
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
+#define INTERP_NAME process_instruction_traced
+#define INTERP_BEFORE(id, inst, pc) trace(inst, pc)
+#include "interp.def"
 
-            NEXT_STATE.REGS[rt] = mem_read_32(addr);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x28: {
-            // SB
+#define INTERP_NAME process_instruction_stats
+#define INTERP_BEFORE(id, inst, pc) ISA_COUNTS[id]++
+#include "interp.def"
 
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
+#define INTERP_NAME process_instruction_timing
+#define INTERP_BEFORE(id, inst, pc) ISA_CYCLES += ISA_INFO[id].cycles
+#include "interp.def"
 
-            uint32_t val = (mem_read_32(addr) & 0xffffff00) |
-                           (CURRENT_STATE.REGS[rt] & 0xff);
+#define INTERP_NAME process_instruction_coverage
+#define INTERP_BEFORE(id, inst, pc)                            \
+    coverage_hit(pc, ISA_INFO[id].kind != ISA_KIND_PLAIN &&    \
+                         ISA_INFO[id].kind != ISA_KIND_SYSCALL)
+#include "interp.def"
 
-            mem_write_32(addr, val);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x29: {
-            // SH
+/* Plugin events. A block starts at any instruction not reached by falling
+ * through from a plain one; 1 never matches a PC. */
+static uint32_t plugin_fall_through = 1;
 
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
+static inline void plugin_before(isa_id_t id, uint32_t inst, uint32_t pc) {
+    if (pc != plugin_fall_through) {
+        plugin_record(SIM_EVENT_BLOCK, 0, pc, 0, 0);
+    }
+    plugin_fall_through = ISA_INFO[id].kind == ISA_KIND_PLAIN ? pc + 4 : 1;
+    plugin_record(SIM_EVENT_INSN, 4, pc, inst, id);
+    if (ISA_INFO[id].kind == ISA_KIND_SYSCALL) {
+        plugin_record(SIM_EVENT_SYSCALL, 0, pc, CURRENT_STATE.REGS[2],
+                      CURRENT_STATE.REGS[4]);
+    }
+}
 
-            uint32_t val = (mem_read_32(addr) & 0xffff0000) |
-                           (CURRENT_STATE.REGS[rt] & 0xffff);
-            mem_write_32(addr, val);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        case 0x2b: {
-            // SW
-            uint32_t addr = sign_ext(imm) + CURRENT_STATE.REGS[rs];
+static inline uint32_t plugin_read(uint32_t pc, uint32_t addr,
+                                   uint32_t size) {
+    uint32_t value = load(addr, size);
+    plugin_record(SIM_EVENT_MEM_READ, size, pc, addr, value);
+    return value;
+}
 
-            mem_write_32(addr, CURRENT_STATE.REGS[rt]);
-            NEXT_STATE.PC = CURRENT_STATE.PC + 4;
-            break;
-        }
-        default: {
-            printf("unimplemented instruction: 0x%08x\n", inst);
-            break;
-        }
-    }
+static inline void plugin_write(uint32_t pc, uint32_t addr, uint32_t size,
+                                uint32_t value) {
+    plugin_record(SIM_EVENT_MEM_WRITE, size, pc, addr, value);
+    store(addr, size, value);
 }
+
+#define INTERP_NAME process_instruction_plugin
+#define INTERP_BEFORE(id, inst, pc) plugin_before(id, inst, pc)
+#define INTERP_LOAD(addr, size) plugin_read(pc, addr, size)
+#define INTERP_STORE(addr, size, v) plugin_write(pc, addr, size, v)
+#include "interp.def"
@@ -0,0 +1,461 @@
+#include "syscall.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "shell.h"
+
+int SYSCALL_EXIT_CODE;
+int SYSCALL_QUIET;
+int SYSCALL_DEFER_INPUT;
+int SYSCALL_INPUT_WAITING;
+uint64_t SYSCALL_OUTPUT_BYTES;
+uint64_t SYSCALL_OUTPUT_HASH = SYSCALL_HASH_SEED;
+
+static char out_buf[SYSCALL_OUT_BUFFER];
+static uint32_t out_len;
+
+/* host descriptor + 1 of each guest file, 0 when closed */
+static int files[SYSCALL_MAX_FILES] = { 1, 2, 3 };
+
+/* end of the heap, as an offset from its base */
+static uint32_t heap_break;
+
+/* A call which read the console or used a host file, as it ran. */
+typedef struct {
+    uint64_t count;     /* INSTRUCTION_COUNT of the syscall */
+    uint32_t result;    /* $v0 after it */
+    uint32_t addr, len; /* guest memory it filled in */
+    char *data;
+} record_t;
+
+/* in instruction order, kept while checkpoints are enabled */
+static record_t *records;
+static uint32_t num_records, records_cap;
+
+void syscall_flush(void) {
+    if (out_len != 0) {
+        fwrite(out_buf, 1, out_len, stdout);
+        out_len = 0;
+    }
+    fflush(stdout);
+}
+
+static void out_write(const char *data, uint32_t len) {
+    uint32_t i;
+
+    if (SYSCALL_QUIET) {
+        return;
+    }
+    for (i = 0; i < len; i++) {
+        SYSCALL_OUTPUT_HASH =
+            (SYSCALL_OUTPUT_HASH ^ (uint8_t)data[i]) * SYSCALL_HASH_PRIME;
+    }
+    SYSCALL_OUTPUT_BYTES += len;
+    if (out_len + len > sizeof(out_buf)) {
+        syscall_flush();
+        if (len > sizeof(out_buf)) {
+            fwrite(data, 1, len, stdout);
+            return;
+        }
+    }
+    memcpy(out_buf + out_len, data, len);
+    out_len += len;
+}
+
+void syscall_forget(uint64_t count) {
+    while (num_records > 0 && records[num_records - 1].count >= count) {
+        free(records[--num_records].data);
+    }
+}
+
+void syscall_reset(void) {
+    int fd;
+
+    for (fd = 3; fd < SYSCALL_MAX_FILES; fd++) {
+        if (files[fd] != 0) {
+            close(files[fd] - 1);
+            files[fd] = 0;
+        }
+    }
+    heap_break = 0;
+    SYSCALL_EXIT_CODE = 0;
+    SYSCALL_OUTPUT_BYTES = 0;
+    SYSCALL_OUTPUT_HASH = SYSCALL_HASH_SEED;
+    syscall_forget(0);
+}
+
+uint32_t syscall_break(void) {
+    return heap_break;
+}
+
+void syscall_set_break(uint32_t brk) {
+    heap_break = brk;
+}
+
+/// Copy guest memory out to `dst`. Returns the bytes copied, which is short
+/// when the range runs off the end of a memory region.
+static uint32_t copy_in(char *dst, uint32_t addr, uint32_t len) {
+    uint32_t done = 0, avail;
+    uint8_t *mem;
+
+    while (done < len && (mem = mem_ptr(addr + done, &avail)) != NULL) {
+        if (avail > len - done) {
+            avail = len - done;
+        }
+        memcpy(dst + done, mem, avail);
+        done += avail;
+    }
+    return done;
+}
+
+/// Copy `len` bytes into guest memory, keeping checkpoints informed.
+static uint32_t copy_out(uint32_t addr, const char *src, uint32_t len) {
+    uint32_t done = 0, avail;
+    uint64_t page;
+    uint8_t *mem;
+
+    while (done < len && (mem = mem_ptr(addr + done, &avail)) != NULL) {
+        if (avail > len - done) {
+            avail = len - done;
+        }
+        if (CHECKPOINT_INTERVAL != 0) {
+            for (page = (addr + done) & ~(CHECKPOINT_PAGE_SIZE - 1);
+                 page < (uint64_t)addr + done + avail;
+                 page += CHECKPOINT_PAGE_SIZE) {
+                checkpoint_write_hook(page);
+            }
+        }
+        memcpy(mem, src + done, avail);
+        done += avail;
+    }
+    return done;
+}
+
+/// Read a NUL terminated guest string into `dst`, cutting it at `size - 1`
+/// characters. Returns the length, or -1 if it leaves mapped memory.
+static int copy_string_in(char *dst, uint32_t addr, uint32_t size) {
+    uint32_t done = 0, avail, n;
+    uint8_t *mem, *end;
+
+    while (done + 1 < size) {
+        if ((mem = mem_ptr(addr + done, &avail)) == NULL) {
+            return -1;
+        }
+        n = avail < size - 1 - done ? avail : size - 1 - done;
+        end = memchr(mem, '\0', n);
+        if (end != NULL) {
+            n = end - mem;
+            memcpy(dst + done, mem, n);
+            done += n;
+            break;
+        }
+        memcpy(dst + done, mem, n);
+        done += n;
+    }
+    dst[done] = '\0';
+    return done;
+}
+
+static void print_string(uint32_t addr) {
+    uint32_t avail, n;
+    uint8_t *mem, *end;
+
+    while ((mem = mem_ptr(addr, &avail)) != NULL) {
+        end = memchr(mem, '\0', avail);
+        n = end != NULL ? (uint32_t)(end - mem) : avail;
+        out_write((const char *)mem, n);
+        if (end != NULL) {
+            return;
+        }
+        addr += n;
+    }
+}
+
+/// Read a line of at most `size - 1` characters from the console, keeping
+/// the newline like fgets. Returns the length, 0 at end of input.
+static uint32_t read_line(char *dst, uint32_t size) {
+    syscall_flush();
+    if (size == 0 || fgets(dst, size, stdin) == NULL) {
+        if (size != 0) {
+            dst[0] = '\0';
+        }
+        return 0;
+    }
+    return strlen(dst);
+}
+
+/// Read a line of at most `size - 1` characters into guest memory at `addr`
+/// and NUL terminate it, a piece at a time so nothing of the guest's size
+/// is allocated. Returns the bytes stored, with the NUL.
+static uint32_t read_string(uint32_t addr, uint32_t size) {
+    char buf[4096];
+    uint32_t done = 0, n;
+
+    while (done + 1 < size) {
+        n = size - 1 - done < sizeof(buf) - 1 ? size - 1 - done
+                                               : sizeof(buf) - 1;
+        if ((n = read_line(buf, n + 1)) == 0) {
+            break;
+        }
+        copy_out(addr + done, buf, n);
+        done += n;
+        if (buf[n - 1] == '\n') {
+            break;
+        }
+    }
+    copy_out(addr + done, "", 1);
+    return done + 1;
+}
+
+/// Keep the result of a call which just ran, and the guest memory it filled
+/// in, for replay_record().
+static void add_record(uint32_t result, uint32_t addr, uint32_t len) {
+    record_t *record;
+
+    if (CHECKPOINT_INTERVAL == 0) {
+        return;
+    }
+    /* anything later is a future that was undone */
+    syscall_forget(INSTRUCTION_COUNT);
+    if (num_records == records_cap) {
+        records_cap = records_cap ? records_cap * 2 : 64;
+        records = realloc(records, records_cap * sizeof(record_t));
+    }
+    record = &records[num_records++];
+    record->count = INSTRUCTION_COUNT;
+    record->result = result;
+    record->addr = addr;
+    record->data = len != 0 ? malloc(len) : NULL;
+    record->len = len != 0 ? copy_in(record->data, addr, len) : 0;
+}
+
+static record_t *find_record(void) {
+    uint32_t lo = 0, hi = num_records, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (records[mid].count < INSTRUCTION_COUNT) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < num_records && records[lo].count == INSTRUCTION_COUNT
+               ? &records[lo]
+               : NULL;
+}
+
+static uint32_t sys_sbrk(int32_t amount) {
+    uint32_t old = heap_break, size;
+
+    /* keep the break word aligned, as MARS does */
+    size = heap_break + (((uint32_t)amount + 3) & ~3u);
+    if (amount < 0 || size < heap_break || mem_heap_grow(size) != 0) {
+        return 0xffffffff;
+    }
+    heap_break = size;
+    return mem_heap_base() + old;
+}
+
+/// MARS open flags: 0 read, 1 write (create, truncate), 9 append.
+static int32_t sys_open(uint32_t name_addr, uint32_t flags, uint32_t mode) {
+    char name[PATH_MAX];
+    int host_flags, fd;
+
+    if (copy_string_in(name, name_addr, sizeof(name)) < 0) {
+        return -1;
+    }
+    switch (flags) {
+        case 0:
+            host_flags = O_RDONLY;
+            break;
+        case 1:
+            host_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case 9:
+            host_flags = O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        default:
+            return -1;
+    }
+    for (fd = 3; fd < SYSCALL_MAX_FILES; fd++) {
+        if (files[fd] == 0) {
+            files[fd] = open(name, host_flags, mode ? mode : 0644) + 1;
+            return files[fd] == 0 ? -1 : fd;
+        }
+    }
+    return -1;
+}
+
+static int32_t sys_read(uint32_t fd, uint32_t addr, uint32_t len) {
+    char buf[4096];
+    uint32_t done = 0, n;
+    ssize_t got;
+
+    if (fd >= SYSCALL_MAX_FILES || files[fd] == 0 || fd == 1 || fd == 2) {
+        return -1;
+    }
+    if (fd == 0) {
+        /* the console shares stdin with the shell, so go through stdio */
+        n = read_line(buf, (len < sizeof(buf) ? len : sizeof(buf) - 1) + 1);
+        return copy_out(addr, buf, n);
+    }
+    while (done < len) {
+        n = len - done < sizeof(buf) ? len - done : sizeof(buf);
+        if ((got = read(files[fd] - 1, buf, n)) < 0) {
+            return done ? (int32_t)done : -1;
+        }
+        if (got == 0 || copy_out(addr + done, buf, got) != (uint32_t)got) {
+            break;
+        }
+        done += got;
+    }
+    return done;
+}
+
+static int32_t sys_write(uint32_t fd, uint32_t addr, uint32_t len) {
+    char buf[4096];
+    uint32_t done = 0, n;
+
+    if (fd >= SYSCALL_MAX_FILES || files[fd] == 0 || fd == 0) {
+        return -1;
+    }
+    while (done < len) {
+        n = len - done < sizeof(buf) ? len - done : sizeof(buf);
+        if ((n = copy_in(buf, addr + done, n)) == 0) {
+            break;
+        }
+        if (fd == 1) {
+            out_write(buf, n);
+        } else if (fd == 2) {
+            if (!SYSCALL_QUIET) {
+                syscall_flush();
+                fwrite(buf, 1, n, stderr);
+            }
+        } else if (write(files[fd] - 1, buf, n) != (ssize_t)n) {
+            return done ? (int32_t)done : -1;
+        }
+        done += n;
+    }
+    return done;
+}
+
+static int32_t sys_close(uint32_t fd) {
+    if (fd >= SYSCALL_MAX_FILES || files[fd] == 0) {
+        return -1;
+    }
+    if (fd > 2) {
+        close(files[fd] - 1);
+        files[fd] = 0;
+    }
+    return 0;
+}
+
+/// Redo a call that already ran from its record: the same result and guest
+/// memory, without reading the console or touching host files again.
+/// Console writes are not recorded, they go through out_write as usual.
+static void replay_record(const record_t *record, uint32_t v0) {
+    copy_out(record->addr, record->data, record->len);
+    if (v0 != SYS_READ_STRING) {
+        NEXT_STATE.REGS[2] = record->result;
+    }
+}
+
+int syscall_run(void) {
+    uint32_t v0 = CURRENT_STATE.REGS[2];
+    uint32_t a0 = CURRENT_STATE.REGS[4];
+    uint32_t a1 = CURRENT_STATE.REGS[5];
+    uint32_t a2 = CURRENT_STATE.REGS[6];
+    record_t *record;
+    char buf[64];
+    uint32_t n;
+
+    if (num_records != 0 && (record = find_record()) != NULL) {
+        replay_record(record, v0);
+        return 1;
+    }
+    if (SYSCALL_DEFER_INPUT &&
+        (v0 == SYS_READ_INT || v0 == SYS_READ_STRING || v0 == SYS_READ_CHAR ||
+         (v0 == SYS_READ && a0 == 0))) {
+        /* stays on the syscall, like exit */
+        SYSCALL_INPUT_WAITING = 1;
+        return 0;
+    }
+
+    switch (v0) {
+        case SYS_PRINT_INT:
+            n = snprintf(buf, sizeof(buf), "%d", (int32_t)a0);
+            out_write(buf, n);
+            break;
+        case SYS_PRINT_STRING:
+            print_string(a0);
+            break;
+        case SYS_READ_INT:
+            read_line(buf, sizeof(buf));
+            NEXT_STATE.REGS[2] = (uint32_t)strtol(buf, NULL, 10);
+            add_record(NEXT_STATE.REGS[2], 0, 0);
+            break;
+        case SYS_READ_STRING:
+            if ((int32_t)a1 < 1) {
+                break;
+            }
+            add_record(0, a0, read_string(a0, a1));
+            break;
+        case SYS_SBRK:
+            NEXT_STATE.REGS[2] = sys_sbrk((int32_t)a0);
+            break;
+        case SYS_EXIT:
+            SYSCALL_EXIT_CODE = 0;
+            syscall_flush();
+            return 0;
+        case SYS_PRINT_CHAR:
+            buf[0] = a0;
+            out_write(buf, 1);
+            break;
+        case SYS_READ_CHAR: {
+            int c;
+
+            syscall_flush();
+            c = getchar();
+            NEXT_STATE.REGS[2] = c == EOF ? 0xffffffff : (uint32_t)c;
+            add_record(NEXT_STATE.REGS[2], 0, 0);
+            break;
+        }
+        case SYS_OPEN:
+            NEXT_STATE.REGS[2] = sys_open(a0, a1, a2);
+            add_record(NEXT_STATE.REGS[2], 0, 0);
+            break;
+        case SYS_READ:
+            NEXT_STATE.REGS[2] = sys_read(a0, a1, a2);
+            add_record(NEXT_STATE.REGS[2], a1,
+                       (int32_t)NEXT_STATE.REGS[2] > 0 ? NEXT_STATE.REGS[2]
+                                                       : 0);
+            break;
+        case SYS_WRITE:
+            NEXT_STATE.REGS[2] = sys_write(a0, a1, a2);
+            if (a0 > 2) {
+                add_record(NEXT_STATE.REGS[2], 0, 0);
+            }
+            break;
+        case SYS_CLOSE:
+            NEXT_STATE.REGS[2] = sys_close(a0);
+            add_record(NEXT_STATE.REGS[2], 0, 0);
+            break;
+        case SYS_EXIT2:
+            SYSCALL_EXIT_CODE = (int32_t)a0;
+            syscall_flush();
+            return 0;
+        default:
+            syscall_flush();
+            printf("Unsupported syscall %u at PC 0x%08x\n", v0,
+                   CURRENT_STATE.PC);
+            break;
+    }
+    return 1;
+}
@@ -0,0 +1,75 @@
+#ifndef _SIM_SYSCALL_H_
+#define _SIM_SYSCALL_H_
+
+#include <stdint.h>
+
+/// SPIM/MARS system call numbers, selected by $v0.
+#define SYS_PRINT_INT    1
+#define SYS_PRINT_STRING 4
+#define SYS_READ_INT     5
+#define SYS_READ_STRING  8
+#define SYS_SBRK         9
+#define SYS_EXIT         10
+#define SYS_PRINT_CHAR   11
+#define SYS_READ_CHAR    12
+#define SYS_OPEN         13
+#define SYS_READ         14
+#define SYS_WRITE        15
+#define SYS_CLOSE        16
+#define SYS_EXIT2        17
+
+/// Guest file descriptors, 0 to 2 are the console.
+#define SYSCALL_MAX_FILES 32
+
+/// Console output is collected in a buffer of this size and written out
+/// when it fills, before the guest reads the console, and when the
+/// simulation stops.
+#define SYSCALL_OUT_BUFFER 65536
+
+/// Exit code passed to exit2, 0 after a plain exit.
+extern int SYSCALL_EXIT_CODE;
+
+/// Set while replaying instructions which already ran, so console output
+/// is not printed twice.
+extern int SYSCALL_QUIET;
+
+/// Bytes of console output written since the program was loaded, and their
+/// 64-bit FNV-1a hash, so a run's output can be compared without keeping it.
+extern uint64_t SYSCALL_OUTPUT_BYTES;
+extern uint64_t SYSCALL_OUTPUT_HASH;
+
+#define SYSCALL_HASH_SEED 0xcbf29ce484222325ull
+#define SYSCALL_HASH_PRIME 0x100000001b3ull
+
+/// Set by the shell while it reads stdin itself, during a background `go`.
+/// A console read is then not run: syscall_run() sets SYSCALL_INPUT_WAITING
+/// and returns 0, leaving the PC on the syscall to be run again later.
+extern int SYSCALL_DEFER_INPUT;
+extern int SYSCALL_INPUT_WAITING;
+
+/// Run the system call selected by CURRENT_STATE, writing results to
+/// NEXT_STATE. Returns 0 when the program exits or a console read is
+/// deferred, 1 otherwise.
+///
+/// While checkpoints are enabled, calls which read the console or use host
+/// files are recorded with their results and the guest memory they filled
+/// in. Running the same instruction again after a reverse step takes the
+/// recorded result instead, so history replays as it happened and host
+/// files are not read, written, opened or closed twice.
+int syscall_run(void);
+
+/// Drop the records of calls at instruction `count` and later, when that
+/// history no longer applies.
+void syscall_forget(uint64_t count);
+
+/// Write out buffered console output.
+void syscall_flush(void);
+
+/// Close guest files and empty the heap, for a newly loaded program.
+void syscall_reset(void);
+
+/// The current end of the heap, saved and restored by checkpoints.
+uint32_t syscall_break(void);
+void syscall_set_break(uint32_t brk);
+
+#endif
@@ -0,0 +1,11 @@
+    .text
+main:
+    addi  $t0, $zero, -3     # 设置t0 = -3
+    slti  $t1, $t0, 5        # -3 < 5，t1 = 1
+    slti  $t2, $t0, -4       # -3 < -4 不成立，t2 = 0
+    sltiu $t3, $t0, 5        # 0xfffffffd < 5 不成立，t3 = 0
+    sltiu $t4, $t0, -1       # 0xfffffffd < 0xffffffff，t4 = 1
+    slt   $t5, $t0, -2       # 伪指令，汇编为 slti，t5 = 1
+    sltu  $t6, $zero, 1      # 伪指令，汇编为 sltiu，t6 = 1
+    li    $v0, 0xa           # 系统调用，退出
+    syscall
@@ -0,0 +1,9 @@
+2008fffd
+29090005
+290afffc
+2d0b0005
+2d0cffff
+290dfffe
+2c0e0001
+2402000a
+0000000c
@@ -4,6 +4,8 @@ import os
 
 argparser = argparse.ArgumentParser()
 argparser.add_argument("--file", type=str, help="file to run")
+argparser.add_argument("--sim", type=str, default="./sim",
+                       help="simulator binary with the built-in assembler")
 
 args = argparser.parse_args()
 
@@ -15,22 +17,7 @@ hex_filename = f'{hex_filename}.x'
 
 print(hex_filename)
 
-cmd = f'spim -asm -db -dl -nmio -nt -ne -file {filename} -assemble -dump'
-subprocess.call(cmd, shell=True)
-
-print(cmd)
-
-output_filename = f'{filename}.out'
-
-with open(output_filename, 'r') as f:
-    # second line
-    line = f.readlines()[1]
-    
-    insts = line.removeprefix(".word").strip().split(", ")
-    
-    insts = list(map(lambda x: int(x, base=16), insts))
-    
-    with open(hex_filename, "w") as f:
-        # fill zero to be 32bits instructions
-        for inst in insts[0x100000:]:
-            f.write(f'{inst:08x}\n')
+# the simulator assembles in-process and prints the symbol map
+cmd = [args.sim, "--asm", filename, hex_filename]
+print(" ".join(cmd))
+subprocess.check_call(cmd)
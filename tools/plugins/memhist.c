@@ -0,0 +1,104 @@
+/// Example plugin: a histogram of memory accesses per 4 KB page, with block
+/// and instruction totals, printed to stderr when the simulator exits.
+///
+///   make plugins && ./sim --plugin ./memhist.so=10 prog.s
+///
+/// The argument is how many of the busiest pages to list (default 16).
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plugin.h"
+
+#define PAGE_SHIFT 12
+#define TABLE_SIZE 4096 /* power of two, open addressing */
+
+typedef struct {
+    uint32_t page; /* page number + 1, 0 when free */
+    uint64_t reads, writes;
+} page_count_t;
+
+static page_count_t table[TABLE_SIZE];
+static uint32_t used;
+static uint64_t blocks, insns, dropped;
+static int top = 16;
+
+static page_count_t *lookup(uint32_t addr) {
+    uint32_t page = (addr >> PAGE_SHIFT) + 1;
+    uint32_t i = (page * 2654435761u) & (TABLE_SIZE - 1);
+
+    while (table[i].page != page) {
+        if (table[i].page == 0) {
+            if (used * 4 >= TABLE_SIZE * 3) {
+                return NULL;
+            }
+            table[i].page = page;
+            used++;
+            break;
+        }
+        i = (i + 1) & (TABLE_SIZE - 1);
+    }
+    return &table[i];
+}
+
+static void on_events(void *user, const sim_event_t *events, uint32_t count) {
+    page_count_t *entry;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        switch (events[i].kind) {
+            case SIM_EVENT_BLOCK:
+                blocks++;
+                break;
+            case SIM_EVENT_INSN:
+                insns++;
+                break;
+            case SIM_EVENT_MEM_READ:
+            case SIM_EVENT_MEM_WRITE:
+                if ((entry = lookup(events[i].addr)) == NULL) {
+                    dropped++;
+                } else if (events[i].kind == SIM_EVENT_MEM_READ) {
+                    entry->reads++;
+                } else {
+                    entry->writes++;
+                }
+                break;
+        }
+    }
+}
+
+static int by_total(const void *a, const void *b) {
+    const page_count_t *x = a, *y = b;
+    uint64_t tx = x->reads + x->writes, ty = y->reads + y->writes;
+    return tx < ty ? 1 : tx > ty ? -1 : 0;
+}
+
+static void report(void *user) {
+    int i;
+
+    qsort(table, TABLE_SIZE, sizeof(page_count_t), by_total);
+    fprintf(stderr, "memhist: %llu instructions, %llu blocks, %u pages\n",
+            (unsigned long long)insns, (unsigned long long)blocks, used);
+    for (i = 0; i < top && i < TABLE_SIZE && table[i].page != 0; i++) {
+        fprintf(stderr, "  0x%08x  %12llu reads  %12llu writes\n",
+                (table[i].page - 1) << PAGE_SHIFT,
+                (unsigned long long)table[i].reads,
+                (unsigned long long)table[i].writes);
+    }
+    if (dropped != 0) {
+        fprintf(stderr, "  (%llu accesses to further pages not counted)\n",
+                (unsigned long long)dropped);
+    }
+}
+
+int sim_plugin_init(int version, const char *args) {
+    if (version != SIM_PLUGIN_VERSION) {
+        return -1;
+    }
+    if (args[0] != '\0') {
+        top = atoi(args);
+    }
+    return sim_plugin_register(SIM_EVENT_BLOCK | SIM_EVENT_INSN |
+                                   SIM_EVENT_MEM_READ | SIM_EVENT_MEM_WRITE,
+                               on_events, report, NULL);
+}